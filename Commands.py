@@ -1,46 +1,438 @@
+import hashlib
+import hmac
+import socket
+import struct
+import threading
+import time
 import serial
+import Protocol
 from Constants import Constants
 
+class UdpLink:
+    """The firmware's UDP transport behind the part of the serial.Serial
+    interface Commands uses. Each write is one datagram, replies come back
+    from whichever robot was last written to. Datagrams carry a counter and
+    a truncated HMAC-SHA256 under Constants.radioKey (see radio.h), replies
+    that fail it are dropped."""
+
+    def __init__(self, address, port=Constants.robotPort, key=Constants.radioKey):
+        if len(key) < 16:
+            raise ValueError("UDP needs the robot's RADIO_UDP_KEY in SDX_RADIO_KEY")
+        self.key = key.encode()
+        #the firmware only takes counters above the last one it saw since
+        #boot, starting from the clock keeps them rising across host restarts
+        self.counter = time.time_ns() // 1000
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setblocking(False)
+        self.sock.connect((address, port))
+
+    def _tag(self, data):
+        return hmac.new(self.key, data, hashlib.sha256).digest()[:Constants.radioTagLength]
+
+    @property
+    def in_waiting(self):
+        return 0
+
+    def write(self, data):
+        self.counter += 1
+        packet = struct.pack("<Q", self.counter) + data
+        try:
+            self.sock.send(packet + self._tag(packet))
+            return len(data)
+        except OSError:
+            # a robot that is not up yet is the same as a lost datagram
+            return 0
+
+    def read(self, size=1):
+        data = b''
+        while True:
+            try:
+                packet = self.sock.recv(2048)
+            except OSError:
+                return data
+            body, tag = packet[:-Constants.radioTagLength], packet[-Constants.radioTagLength:]
+            if len(body) > 8 and hmac.compare_digest(tag, self._tag(body)):
+                data += body[8:]
+
+    def flush(self):
+        pass
+
+    def close(self):
+        self.sock.close()
+
+#bytes an idle robot's UART wakes on, the frame parser skips them
+IDLE_WAKE = b'\x55' * 4
+
 class Commands:
-    def __init__(self, serialPortFile="/dev/ttyUSB0", baudRate=115200):
-        self.ser = serial.Serial(serialPortFile)
-        self.lastSent = "0"
-    
-    def _sendString(self,string):
-        if self.lastSent != string:
-            self.ser.write(string.encode('utf-8'))
-            self.lastSent = string
-    
-    def rotate(self,clockwise = True):
-        if clockwise:
-            if Constants.reverseControls:
-                self._sendString('a')
-            else:
-                self._sendString('d')
+    def __init__(self, serialPortFile="/dev/ttyUSB0", baudRate=Constants.serialBaudRate, transport="serial"):
+        """transport "udp" takes serialPortFile as the robot's address, one
+        Commands per robot."""
+        self.transport = transport
+        if transport == "udp":
+            self.ser = UdpLink(serialPortFile)
         else:
-            if Constants.reverseControls:
-                self._sendString('d')
-            else:
-                self._sendString('a')
-            
+            self.ser = serial.Serial(serialPortFile, baudRate, timeout=0)
+        self.decoder = Protocol.FrameDecoder()
+        self.seq = 0
+        self.token = 0
+        self.lastSentTime = 0
+        #commands of the last _send, the streamed motion state
+        self.lastState = None
+        #seq of the newest frame the firmware has acknowledged
+        self.ackedSeq = None
+        #(x mm, y mm, heading degrees) as last reported by the firmware
+        self.pose = None
+        #latest OP_TELEMETRY report, see Protocol.decodeTelemetry
+        self.telemetry = None
+        self.segmentId = 0
+        #status of each segment sent, None until the firmware reports it
+        self.segments = {}
+        #queue slots the firmware had free at its last segment report
+        self.segmentsFree = None
+        #the firmware's occupancy grid, one log-odds byte (0..15) per cell,
+        #row by row from the -x, -y corner; filled in by syncGrid
+        self.grid = None
+        self.gridCells = 0
+        self.gridCellMm = 0
+        self.gridDirty = None
+        self.recorderDropped = None
+        #sendFrame may be called from the keepalive thread as well
+        self.sendLock = threading.RLock()
+        #last poll() or command from the caller, a loop that stops ticking
+        #stops the heartbeats with it
+        self.lastTick = time.monotonic()
+        if transport != "udp":
+            self.negotiateBaud()
+        #heartbeats go out from their own thread, a frame the camera loop
+        #takes long over must not trip the firmware's dead-man stop, a
+        #camera loop hung for hostStallTimeout must
+        self.closed = threading.Event()
+        self.keepalive = threading.Thread(target=self._keepalive, daemon=True)
+        self.keepalive.start()
+
+    def _send(self, *commands):
+        # state is streamed as is, the firmware drops repeats and commands
+        # superseded before it got to them. An idle robot is left asleep
+        # through the repeats.
+        if self.idle() and commands == self.lastState:
+            return
+        self.lastState = commands
+        self.sendFrame(*commands)
+
+    def sendFrame(self, *commands):
+        self.lastTick = time.monotonic()
+        self._writeFrame(commands)
+
+    def _writeFrame(self, commands):
+        with self.sendLock:
+            # a robot on the radio never sleeps
+            if self.idle() and self.transport != "udp":
+                self.ser.write(IDLE_WAKE)
+                self.ser.flush()
+                time.sleep(Constants.idleWakeDelay)
+            # several commands may share one frame
+            self.ser.write(Protocol.encodeFrame(self.seq, commands))
+            self.seq = (self.seq + 1) & 0xFF
+            self.lastSentTime = time.monotonic()
+
+    def _keepalive(self):
+        # a heartbeat whenever nothing else went out for the keepalive time,
+        # as long as the caller is still ticking
+        while not self.closed.wait(Constants.linkKeepalive / 3):
+            keepalive = Constants.idleKeepalive if self.idle() else Constants.linkKeepalive
+            try:
+                with self.sendLock:
+                    now = time.monotonic()
+                    if now - self.lastSentTime > keepalive and now - self.lastTick < Constants.hostStallTimeout:
+                        self._writeFrame((Protocol.command(Protocol.OP_HEARTBEAT),))
+            except (OSError, serial.SerialException):
+                # the port is gone, the firmware stops the robot on its own
+                return
+
+    def receive(self):
+        frames = self.decoder.feed(self.ser.read(self.ser.in_waiting or 1))
+        for seq, commands in frames:
+            for opcode, params in commands:
+                if opcode == Protocol.OP_POSE:
+                    x, y, heading = params
+                    self.pose = (x, y, heading / 100.0)
+                elif opcode == Protocol.OP_TELEMETRY:
+                    self.telemetry = Protocol.decodeTelemetry(params)
+                elif opcode == Protocol.OP_ACK:
+                    self.ackedSeq = params[0]
+                elif opcode == Protocol.OP_SEGMENT_STATUS:
+                    segmentId, status, free = params
+                    self.segments[segmentId] = status
+                    self.segmentsFree = free
+                elif opcode == Protocol.OP_GRID_STATUS:
+                    self.gridDirty, cells, self.gridCellMm = params
+                    if cells != self.gridCells:
+                        self.gridCells = cells
+                        self.grid = bytearray([Protocol.GRID_PRIOR]) * (cells * cells)
+                elif opcode == Protocol.OP_GRID_TILE and self.grid is not None:
+                    self._storeTile(params[0], params[1:])
+        return frames
+
+    def poll(self):
+        """Takes in whatever the firmware reported since the last call. The
+        firmware's link watchdog is fed from the keepalive thread for as long
+        as poll() or a command comes at least every hostStallTimeout."""
+        self.lastTick = time.monotonic()
+        self.receive()
+
+    def idle(self):
+        """True while the firmware reports its idle mode: at rest, sweeping
+        slowly and light sleeping. The next motion command ends it."""
+        return self.telemetry is not None and self.telemetry['mode'] == 'idle'
+
+    def setPose(self, x, y, heading):
+        """Moves the firmware's dead reckoning estimate, heading in degrees."""
+        self.sendFrame(Protocol.command(Protocol.OP_SET_POSE, int(x), int(y), int(round(heading * 100))))
+
+    def acked(self):
+        """True once the firmware has applied the last frame sent."""
+        return self.ackedSeq == (self.seq - 1) & 0xFF
+
+    def profile(self, reset = False, trace = False, timeout = 0.3):
+        """Per point timing histograms from the firmware profiler, keyed by
+        point name. Bucket i counts samples under 2**(i + 7) cycles. With
+        trace the recent events come back as (core, point, start, cycles)."""
+        flags = (Protocol.PROFILE_DUMP_RESET if reset else 0) | (Protocol.PROFILE_DUMP_TRACE if trace else 0)
+        self.sendFrame(Protocol.command(Protocol.OP_PROFILE_DUMP, flags))
+        points = {}
+        events = []
+        start = time.monotonic()
+        while time.monotonic() - start < timeout:
+            for seq, commands in self.receive():
+                for op, params in commands:
+                    if op == Protocol.OP_PROFILE:
+                        point, count, totalUs, maxCycles, *buckets = params
+                        name = Protocol.PROFILE_POINTS[point] if point < len(Protocol.PROFILE_POINTS) else point
+                        points[name] = {'count': count, 'meanUs': totalUs / count,
+                                        'maxCycles': maxCycles, 'buckets': buckets}
+                    elif op == Protocol.OP_TRACE:
+                        events.append(params)
+        return (points, events) if trace else points
+
+    def _storeTile(self, tile, packed):
+        perRow = self.gridCells // Protocol.GRID_TILE
+        x0 = tile % perRow * Protocol.GRID_TILE
+        y0 = tile // perRow * Protocol.GRID_TILE
+        for i, pair in enumerate(packed):
+            y = y0 + i // (Protocol.GRID_TILE // 2)
+            x = x0 + i % (Protocol.GRID_TILE // 2) * 2
+            self.grid[y * self.gridCells + x] = pair & 0x0F
+            self.grid[y * self.gridCells + x + 1] = pair >> 4
+
+    def syncGrid(self, full = False, clear = False, timeout = 1.0):
+        """Brings self.grid up to date with the firmware's occupancy grid,
+        only tiles changed since the last sync come over unless full. With
+        clear the firmware forgets its map first. True once nothing is
+        left to fetch."""
+        flags = (Protocol.GRID_SYNC_FULL if full or self.grid is None else 0) \
+            | (Protocol.GRID_SYNC_CLEAR if clear else 0)
+        start = time.monotonic()
+        while time.monotonic() - start < timeout:
+            fresh = self.grid is None
+            self.sendFrame(Protocol.command(Protocol.OP_GRID_SYNC, flags))
+            flags = 0
+            for (left, cells, cellMm) in self._await(Protocol.OP_GRID_STATUS, timeout / 4):
+                if fresh:
+                    # the tiles ahead of the first status had no grid to go in
+                    flags = Protocol.GRID_SYNC_FULL
+                elif not left:
+                    return True
+                break
+        return False
+
+    def gridCell(self, x, y):
+        """Log-odds (0..15, Protocol.GRID_PRIOR unknown) of the cell holding
+        the point x, y in mm, from the last syncGrid."""
+        if self.grid is None:
+            return Protocol.GRID_PRIOR
+        cx = int(x // self.gridCellMm) + self.gridCells // 2
+        cy = int(y // self.gridCellMm) + self.gridCells // 2
+        if not (0 <= cx < self.gridCells and 0 <= cy < self.gridCells):
+            return Protocol.GRID_PRIOR
+        return self.grid[cy * self.gridCells + cx]
+
+    def dumpRecorder(self, blocks = 0, timeout = 1.0):
+        """Reads back the firmware's flight recorder, oldest record first:
+        the newest blocks of 255 records from flash (0 for all of them),
+        then what is still in RAM. Each record is a dict of index, tUs,
+        type (Protocol.REC_TYPES) and the fields a to d, see recorder.h.
+        Gives up after timeout without a record and returns what came;
+        self.recorderDropped counts records lost to a full RAM ring."""
+        self.sendFrame(Protocol.command(Protocol.OP_RECORDER_DUMP, int(blocks)))
+        records = []
+        last = time.monotonic()
+        while time.monotonic() - last < timeout:
+            for seq, commands in self.receive():
+                for op, params in commands:
+                    if op == Protocol.OP_RECORD:
+                        index, tUs, kind, a, b, c, d = params
+                        name = Protocol.REC_TYPES[kind] if kind < len(Protocol.REC_TYPES) else kind
+                        records.append({'index': index, 'tUs': tUs, 'type': name,
+                                        'a': a, 'b': b, 'c': c, 'd': d})
+                        last = time.monotonic()
+                    elif op == Protocol.OP_RECORDER_DONE:
+                        self.recorderDropped = params[1]
+                        return records
+        return records
+
+    def setTelemetryRate(self, hz):
+        """Telemetry frames per second from the firmware, 0 turns them off."""
+        self.sendFrame(Protocol.command(Protocol.OP_TELEMETRY_RATE, int(hz)))
+
+    def _await(self, opcode, timeout):
+        """Collects replies with opcode until timeout, yields their params."""
+        start = time.monotonic()
+        while time.monotonic() - start < timeout:
+            for seq, commands in self.receive():
+                for op, params in commands:
+                    if op == opcode:
+                        yield params
+
+    def setVelocity(self, left, right):
+        if Constants.reverseControls:
+            left, right = -left, -right
+        self._send(Protocol.command(Protocol.OP_VELOCITY, int(left), int(right)))
+
+    def drive(self, forward, turn, fire = False):
+        """Forward speed and clockwise turn rate in steps/s, blended into
+        wheel rates by the firmware. With fire the gun cycles while the
+        robot keeps steering."""
+        if Constants.reverseControls:
+            forward, turn = -forward, -turn
+        commands = [Protocol.command(Protocol.OP_DRIVE, int(forward), int(turn))]
+        if fire:
+            commands.append(Protocol.command(Protocol.OP_FIRE, 1, Protocol.FIRE_TRACKING))
+        self._send(*commands)
+
+    def segment(self, left, right, leftRate, rightRate = None):
+        """Queues a move of exactly left and right steps per wheel at the
+        given cruise rates (steps/s) and returns its id. Queued moves run
+        back to back, self.segments[id] turns from None to a
+        Protocol.SEGMENT_* status once the firmware is through with it."""
+        if rightRate is None:
+            rightRate = leftRate
+        if Constants.reverseControls:
+            left, right = -left, -right
+        self.segmentId = (self.segmentId + 1) & 0xFFFF
+        self.segments[self.segmentId] = None
+        self.sendFrame(Protocol.command(Protocol.OP_SEGMENT, int(left), int(right),
+                                        int(abs(leftRate)), int(abs(rightRate)), self.segmentId))
+        return self.segmentId
+
+    def track(self, bearing, bearingRate, forward = 0, fire = False):
+        """Steers onto a target bearing in degrees (clockwise positive) that
+        moves at bearingRate degrees/s as seen by the camera. The firmware
+        extrapolates it between calls and stops the robot once calls stop
+        coming. With fire the gun cycles while tracking."""
+        if Constants.reverseControls:
+            bearing, bearingRate, forward = -bearing, -bearingRate, -forward
+        clamp = lambda v: max(-32768, min(32767, int(round(v))))
+        commands = [Protocol.command(Protocol.OP_TRACK, clamp(bearing * 100), clamp(bearingRate * 100), int(forward))]
+        if fire:
+            commands.append(Protocol.command(Protocol.OP_FIRE, 1, Protocol.FIRE_TRACKING))
+        self.sendFrame(*commands)
+
+    def rotateBy(self, degrees, rate = Constants.turnSpeed):
+        """Spins in place by degrees (clockwise positive) as one ramped move
+        that stops on the exact step, replacing any queued segments. Returns
+        the segment id, completion shows up in self.segments like for
+        segment()."""
+        if Constants.reverseControls:
+            degrees = -degrees
+        self.segmentId = (self.segmentId + 1) & 0xFFFF
+        self.segments[self.segmentId] = None
+        self.sendFrame(Protocol.command(Protocol.OP_ROTATE, int(round(degrees * 100)),
+                                        int(abs(rate)), self.segmentId))
+        return self.segmentId
+
+    def rotate(self,clockwise = True):
+        speed = Constants.turnSpeed if clockwise else -Constants.turnSpeed
+        self.setVelocity(speed, -speed)
+
     def move(self,forward = True):
-        if forward:
-            if Constants.reverseControls:
-                self._sendString('s')
-            else:
-                self._sendString('w')
-        else:
-            if Constants.reverseControls:
-                self._sendString('w')
-            else:
-                self._sendString('s')
-            
+        speed = Constants.driveSpeed if forward else -Constants.driveSpeed
+        self.setVelocity(speed, speed)
+
+    def stop(self):
+        self._send(Protocol.command(Protocol.OP_STOP))
+
     def roam(self):
-        self._sendString('r')
-    
-    def fire(self):
-        self._sendString('f')
-        
-    def __del__(self):
+        self._send(Protocol.command(Protocol.OP_ROAM))
+
+    def fire(self, shots = 1, tracking = False):
+        # with tracking the wheels keep their last command while the gun cycles
+        flags = Protocol.FIRE_TRACKING if tracking else 0
+        self._send(Protocol.command(Protocol.OP_FIRE, shots, flags))
+
+    def ping(self, count = 1, timeout = 0.5):
+        """Round trip time to the firmware in seconds, None unless all
+        count pings (batched in one frame) come back."""
+        tokens = set()
+        for _ in range(count):
+            self.token = (self.token + 1) & 0xFFFFFFFF
+            tokens.add(self.token)
+        start = time.monotonic()
+        self.sendFrame(*[Protocol.command(Protocol.OP_PING, t) for t in tokens])
+        for (token,) in self._await(Protocol.OP_PONG, timeout):
+            tokens.discard(token)
+            if not tokens:
+                return time.monotonic() - start
+        return None
+
+    def _setBaud(self, rate):
+        try:
+            self.ser.baudrate = rate
+        except (ValueError, serial.SerialException):
+            return False
+        self.ser.reset_input_buffer()
+        self.decoder = Protocol.FrameDecoder()
+        return True
+
+    def _tryBaud(self, rate):
+        previous = self.ser.baudrate
+        self.sendFrame(Protocol.command(Protocol.OP_BAUD, rate))
+        for (accepted,) in self._await(Protocol.OP_BAUD_ACK, 0.2):
+            if accepted != rate:
+                return False
+            self.ser.flush()
+            # a full frame of pings has to survive the new rate
+            if self._setBaud(rate) and self.ping(count=12, timeout=0.1) is not None:
+                return True
+            # the firmware reverts on its own once the confirm window passes
+            self._setBaud(previous)
+            time.sleep(0.4)
+            return False
+        return False
+
+    def negotiateBaud(self, rates = Constants.serialBaudRates):
+        """Moves the link to the fastest rate both ends handle reliably and
+        returns it. The firmware may still be at a rate from an earlier run,
+        so it is looked for first. No heartbeat goes out at a stale rate
+        meanwhile."""
+        with self.sendLock:
+            if self.ping() is None:
+                for rate in rates:
+                    if self._setBaud(rate) and self.ping() is not None:
+                        break
+                else:
+                    self._setBaud(Constants.serialBaudRate)
+                    return self.ser.baudrate
+            for rate in sorted(rates, reverse=True):
+                if rate <= self.ser.baudrate or self._tryBaud(rate):
+                    break
+            return self.ser.baudrate
+
+    def close(self):
+        self.closed.set()
+        self.keepalive.join()
         self.ser.close()
+
+    def __del__(self):
+        if hasattr(self, 'closed') and not self.closed.is_set():
+            self.close()
         
@@ -1,3 +1,5 @@
+import os
+
 class Constants:
     cameraIndex = 0
     deleteAtGoneFrame = 10
@@ -13,6 +15,47 @@ class Constants:
     minimumPixelAreaFireRange = 7800
     robotSoundEffectFile = "Ford.wav"
     playSoundRepeatDelay = .040
+    #"serial" for the USB tether or the ESP-NOW bridge (env:espnow_bridge)
+    #on the host's USB port, "udp" for a robot built with RADIO_UDP at
+    #robotAddress. The robot only hears the host address it was built with
+    #(RADIO_PEER_IP)
+    linkTransport = "serial"
     serialDevice = "/dev/ttyUSB0"
+    robotAddress = "192.168.4.10"
+    robotPort = 4210
+    #UDP datagrams are signed with the robot's RADIO_UDP_KEY, taken from the
+    #environment so it is never committed. They are not encrypted, anyone on
+    #the network can read them: UDP is for a trusted network only
+    radioKey = os.environ.get("SDX_RADIO_KEY", "")
+    radioTagLength = 16
+    #Boot rate of the firmware, faster rates are tried from the top down
+    serialBaudRate = 115200
+    serialBaudRates = [2000000, 921600, 460800, 230400]
+    #Firmware falls back to serialBaudRate after 3 s of silence and stops
+    #the robot after LINK_TIMEOUT_MS (90 ms, three missed beats), the
+    #Commands keepalive thread sends a heartbeat when nothing else went out
+    #for this long
+    linkKeepalive = 0.03
+    #The keepalive thread stops beating once the main loop has neither
+    #polled nor sent a command for this long (a hung camera read or
+    #detector), so the firmware stops the robot LINK_TIMEOUT_MS later.
+    #A few slow Haar frames fit inside it
+    hostStallTimeout = 0.5
+    #An idle robot (telemetry mode "idle") light sleeps, it is only kept
+    #from the baud fallback and the bytes that wake it are lost, so frames
+    #to it lead with a preamble and this pause. Keep it under the firmware's
+    #IDLE_LINK_TIMEOUT_MS (2.5 s)
+    idleKeepalive = 1.0
+    idleWakeDelay = 0.003
     reverseControls = True
+    #Wheel rates in steps/s sent with each motion command
+    driveSpeed = 750
+    turnSpeed = 750
+    #Sightings of a face its bearing rate is fitted over
+    trackHistoryFrames = 5
+    #Horizontal field of view of the camera, turns pixel offsets into the
+    #angle of a single rotateBy move
+    cameraFovDeg = 60
+    #An aiming rotation not reported done by then is given up on
+    aimTimeout = 1.0
     enableSound = False 
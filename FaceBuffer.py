@@ -1,4 +1,5 @@
 import math
+import time
 from Constants import Constants
 
 class Face:
@@ -6,6 +7,27 @@ class Face:
         self.faceId = faceId
         self.x, self.y, self.w, self.h = x,y,h,w
         self.framesSinceLastSeen = 0
+        #(time, center x) of the last few sightings, newest last
+        self.history = []
+
+    def centerX(self):
+        return self.x + self.w / 2
+
+    def seen(self, t):
+        self.history.append((t, self.centerX()))
+        del self.history[:-Constants.trackHistoryFrames]
+
+    def velocityX(self):
+        """Horizontal speed of the face center in pixels/s, a least squares
+        fit over the history, 0 until it was seen twice."""
+        if len(self.history) < 2:
+            return 0.0
+        meanT = sum(t for t, _ in self.history) / len(self.history)
+        meanX = sum(x for _, x in self.history) / len(self.history)
+        var = sum((t - meanT) ** 2 for t, _ in self.history)
+        if var == 0:
+            return 0.0
+        return sum((t - meanT) * (x - meanX) for t, x in self.history) / var
 
 class RawFace:
     def __init__(self, x, y, w, h):
@@ -27,7 +49,7 @@ class FaceBuffer:
         for i in range(faceCount):
             self.faceList[i].framesSinceLastSeen += 1
 
-    def processIfFaceExists(self, rawFace):
+    def processIfFaceExists(self, rawFace, t):
         faceCount = len(self.faceList)
 
         for i in range(faceCount):
@@ -41,26 +63,31 @@ class FaceBuffer:
                 self.faceList[i].y = rawFace.y
                 self.faceList[i].w = rawFace.w
                 self.faceList[i].h = rawFace.h
+                self.faceList[i].seen(t)
                 
                 return True
                 
 
         return False
 
-    def addNewFace(self, rawFace):
-        self.faceList.append(Face(self.nextFaceId, rawFace.x, rawFace.y, rawFace.w, rawFace.h))
+    def addNewFace(self, rawFace, t):
+        face = Face(self.nextFaceId, rawFace.x, rawFace.y, rawFace.w, rawFace.h)
+        face.seen(t)
+        self.faceList.append(face)
         self.nextFaceId += 1
 
     def cullOldFaces(self):
         self.faceList = list(filter(self.isNotOldFace, self.faceList))
 
     #Only use this
-    def processNewFrame(self, rawFaceList):
+    def processNewFrame(self, rawFaceList, t = None):
+        if t is None:
+            t = time.monotonic()
         self.incrementSinceLastSeen()
         
         for rawFace in rawFaceList:
-            if not self.processIfFaceExists(rawFace):
-                self.addNewFace(rawFace)
+            if not self.processIfFaceExists(rawFace, t):
+                self.addNewFace(rawFace, t)
     
         self.cullOldFaces()
 
@@ -0,0 +1,90 @@
+import struct
+import sdx_protocol
+
+# The codec is compiled from esp32_platformio_code/lib/sdx_protocol, the
+# firmware's own header (python3 setup.py build_ext --inplace). Opcodes and
+# parameter layouts come from there, only flag values live here.
+SYNC = sdx_protocol.SYNC
+VERSION = sdx_protocol.VERSION
+MAX_PAYLOAD = sdx_protocol.MAX_PAYLOAD
+
+for _name, _opcode in sdx_protocol.opcodes().items():
+    globals()['OP_' + _name] = _opcode
+
+PARAM_FORMATS = sdx_protocol.param_formats()
+
+FIRE_TRACKING = 0x01
+
+SEGMENT_DONE = 0
+SEGMENT_QUEUE_FULL = 1
+SEGMENT_CANCELLED = 2
+
+PROFILE_POINTS = ('echoIsr', 'ultraTrig', 'rangeFilter', 'planner',
+                  'linkRx', 'comms', 'control', 'telemetry', 'grid')
+GRID_SYNC_FULL = 0x01
+GRID_SYNC_CLEAR = 0x02
+GRID_TILE = 8
+GRID_PRIOR = 8
+GRID_OCCUPIED = 11
+
+REC_TYPES = ('none', 'sensor', 'command', 'mode', 'idle', 'fire', 'boot')
+
+PROFILE_DUMP_RESET = 0x01
+PROFILE_DUMP_TRACE = 0x02
+
+TELEMETRY_MODES = ('host', 'roam', 'timeout', 'segments', 'track', 'idle')
+GUN_STATES = ('idle', 'pull', 'cooldown')
+
+crc16 = sdx_protocol.crc16
+
+def command(opcode, *params):
+    return bytes([opcode]) + struct.pack(PARAM_FORMATS[opcode], *params)
+
+def encodeFrame(seq, commands):
+    return sdx_protocol.encode_frame(seq, b''.join(commands))
+
+def decodeCommands(payload):
+    commands = []
+    offset = 0
+    while offset < len(payload):
+        opcode = payload[offset]
+        fmt = PARAM_FORMATS.get(opcode)
+        if fmt is None:
+            break
+        size = struct.calcsize(fmt)
+        if offset + 1 + size > len(payload):
+            break
+        commands.append((opcode, struct.unpack_from(fmt, payload, offset + 1)))
+        offset += 1 + size
+    return commands
+
+def decodeTelemetry(params):
+    t, *rest = params
+    ranges, confidence, rest = rest[:5], rest[5:10], rest[10:]
+    (mode, motion, rate1, rate2, gun, controlUs, scanUs, jitterUs,
+     wcetUs, overruns, heap, *stacks) = rest
+    return {
+        'time': t / 1000.0,
+        'ranges': list(ranges),
+        'confidence': list(confidence),
+        'mode': TELEMETRY_MODES[mode] if mode < len(TELEMETRY_MODES) else mode,
+        'motion': chr(motion) if motion else None,
+        'stepRates': (rate1, rate2),
+        'gun': GUN_STATES[gun] if gun < len(GUN_STATES) else gun,
+        'controlUs': controlUs,
+        'scanUs': scanUs,
+        'controlJitterUs': jitterUs,
+        'controlWcetUs': wcetUs,
+        'controlOverruns': overruns,
+        'freeHeap': heap,
+        'stackFree': dict(zip(('control', 'comms', 'sensor', 'linkRx', 'linkTx', 'telemetry'), stacks)),
+    }
+
+class FrameDecoder:
+    """Incremental frame parser, feed() returns the frames completed by data."""
+
+    def __init__(self):
+        self.parser = sdx_protocol.Parser()
+
+    def feed(self, data):
+        return [(seq, decodeCommands(payload)) for seq, payload in self.parser.feed(data)]
@@ -0,0 +1,67 @@
+// ESP-NOW bridge, the host's side of a -DRADIO_ESPNOW robot. An ESP32 on the
+// host's USB port passes frames between its serial port and the robot, so
+// the host talks to it as to the USB tether (linkTransport "serial").
+// Serial bytes are parsed into frames and each one goes out as a packet of
+// its own, packets from the robot are written out as they are. Only the
+// robot at RADIO_ROBOT_MAC is heard, encrypted with RADIO_PMK and RADIO_LMK
+// as on the robot, on RADIO_CHANNEL.
+//
+// The serial port stays at LINK_BAUD: OP_BAUD only means something on the
+// robot's own UART, so the host's baud negotiation finds no faster rate.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_now.h>
+#include <esp_wifi.h>
+
+#include "config.h"
+#include "protocol.h"
+
+static const uint8_t robot_mac[ESP_NOW_ETH_ALEN] = {RADIO_ROBOT_MAC};
+static_assert(sizeof(RADIO_PMK) == ESP_NOW_KEY_LEN + 1, "RADIO_PMK is 16 characters");
+static_assert(sizeof(RADIO_LMK) == ESP_NOW_KEY_LEN + 1, "RADIO_LMK is 16 characters");
+
+static proto_parser parser;
+
+// runs in the WiFi task, the loop never writes to Serial
+static void bridge_rx(const uint8_t * mac, const uint8_t * data, int len)
+{
+    if (memcmp(mac, robot_mac, sizeof(robot_mac)))
+        return;
+    Serial.write(data, len);
+}
+
+void setup()
+{
+    Serial.begin(LINK_BAUD);
+    proto_parser_reset(parser);
+
+    // modem sleep would hold packets for up to a beacon interval
+    WiFi.mode(WIFI_STA);
+    WiFi.setSleep(false);
+    esp_wifi_set_channel(RADIO_CHANNEL, WIFI_SECOND_CHAN_NONE);
+    esp_now_init();
+    esp_now_set_pmk((const uint8_t *)RADIO_PMK);
+
+    esp_now_peer_info_t info = {};
+    memcpy(info.peer_addr, robot_mac, sizeof(robot_mac));
+    memcpy(info.lmk, RADIO_LMK, ESP_NOW_KEY_LEN);
+    info.channel = RADIO_CHANNEL;
+    info.ifidx = WIFI_IF_STA;
+    info.encrypt = true;
+    esp_now_add_peer(&info);
+    esp_now_register_recv_cb(bridge_rx);
+}
+
+void loop()
+{
+    while (Serial.available())
+    {
+        if (!proto_feed(parser, Serial.read()))
+            continue;
+        uint8_t frame[PROTO_MAX_FRAME];
+        size_t len = proto_encode(frame, parser.frame.seq, parser.frame.payload, parser.frame.len);
+        esp_now_send(robot_mac, frame, len);
+    }
+    delay(1);
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+// Pins, sonar layout, gun and wheel geometry come from the robot profile
+// of the chassis being built, see robot_profile.h
+#include "robot_profile.h"
+
+// STEPPER CONFIG
+#define STEPPER_MAX_RATE 4000   // steps/s, ceiling for any requested rate
+#define STEPPER_MIN_RATE 20     // steps/s, below this the pulse train is off
+#define STEPPER_ACCEL 6000      // steps/s^2
+#define STEPPER_JERK 60000      // steps/s^3, 0 selects a trapezoidal ramp
+#define STEPPER_TICK_HZ CONTROL_RATE_HZ  // ramps advance once per control tick
+#define STEPPER_CRAWL_RATE 100  // steps/s, last steps onto an exact goal
+
+// SEGMENT CONFIG
+#define SEGMENT_QUEUE 16        // queued OP_SEGMENT moves, power of two
+
+// ODOMETRY CONFIG
+#define ODOM_HZ 100
+#define ODOM_REPORT_HZ 10       // OP_POSE frames to the host, 0 = off
+
+// LINK CONFIG
+#ifndef LINK_UART                   // a build moving the link sets all three
+#define LINK_UART UART_NUM_0        // the USB serial port
+#define LINK_TX_PIN UART_PIN_NO_CHANGE
+#define LINK_RX_PIN UART_PIN_NO_CHANGE
+#endif
+#define LINK_BAUD 115200            // boot and fallback rate
+#define LINK_BAUD_MIN 9600
+#define LINK_BAUD_MAX 2000000
+#define LINK_BAUD_CONFIRM_MS 300    // a new rate must see a valid frame by then
+#define LINK_BAUD_IDLE_MS 3000      // silence before falling back to LINK_BAUD
+// the host beats every 30 ms from its own thread, camera frame time does not
+// delay it
+#define LINK_TIMEOUT_MS 90          // silence before the dead-man stop, three missed beats
+#define LINK_RX_BUFFER 1024
+#define LINK_TX_BUFFER 1024         // UART driver ring, fed by the TX task
+#define LINK_TX_QUEUE 2048          // frames waiting for the TX task
+#define LINK_TX_CHUNK 256
+#define LINK_EVENT_QUEUE 16
+#define LINK_FRAME_QUEUE 8
+#define LINK_RX_CHUNK 64
+#define LINK_RX_TIMEOUT_SYMBOLS 2   // idle byte times before a data event
+#define LINK_RX_FULL_THRESHOLD 16   // FIFO bytes before a data event
+#define LINK_TRANSPORTS 2           // the UART and the radio
+
+// RADIO CONFIG
+// -DRADIO_ESPNOW or -DRADIO_UDP also takes command frames over WiFi
+#if defined(RADIO_ESPNOW) || defined(RADIO_UDP)
+#define RADIO_ENABLED 1
+#else
+#define RADIO_ENABLED 0
+#endif
+// the network credentials are never committed, they come from build flags or
+// the git-ignored include/secrets.h (see env:dart_x_radio)
+#if (RADIO_ENABLED || defined(RADIO_BRIDGE)) && __has_include("secrets.h")
+#include "secrets.h"
+#endif
+#if defined(RADIO_UDP) && (!defined(RADIO_SSID) || !defined(RADIO_PASSWORD))
+#error "RADIO_UDP needs RADIO_SSID and RADIO_PASSWORD from build flags or include/secrets.h"
+#endif
+// so are the one peer the robot takes frames from: RADIO_PEER_IP ("a.b.c.d")
+// and RADIO_UDP_KEY (16 characters or more, the host's SDX_RADIO_KEY) for
+// UDP, RADIO_PEER_MAC (six bytes, 0x24, 0x6F, ...) of the bridge and the
+// 16 character RADIO_PMK and RADIO_LMK keys for ESP-NOW. UDP datagrams are
+// authenticated but not encrypted, use it on a trusted network only.
+#if defined(RADIO_UDP) && (!defined(RADIO_PEER_IP) || !defined(RADIO_UDP_KEY))
+#error "RADIO_UDP needs RADIO_PEER_IP and RADIO_UDP_KEY from build flags or include/secrets.h"
+#endif
+#if defined(RADIO_ESPNOW) && (!defined(RADIO_PEER_MAC) || !defined(RADIO_PMK) || !defined(RADIO_LMK))
+#error "RADIO_ESPNOW needs RADIO_PEER_MAC, RADIO_PMK and RADIO_LMK from build flags or include/secrets.h"
+#endif
+// the bridge (env:espnow_bridge) takes the same keys and RADIO_ROBOT_MAC
+#if defined(RADIO_BRIDGE) && (!defined(RADIO_ROBOT_MAC) || !defined(RADIO_PMK) || !defined(RADIO_LMK))
+#error "RADIO_BRIDGE needs RADIO_ROBOT_MAC, RADIO_PMK and RADIO_LMK from build flags or include/secrets.h"
+#endif
+#define RADIO_CHANNEL 1             // ESP-NOW, the host's bridge must match
+#define RADIO_UDP_PORT 4210
+#define RADIO_TX_QUEUE 2048         // frames waiting for the radio TX task
+#define RADIO_PACKET 250            // largest datagram taken or sent
+
+// PLANNER CONFIG
+#define PLAN_STOP_MM 250            // closer than this a sector is blocked
+#define PLAN_SLOW_MM robot.wall_limit_mm
+#define PLAN_CLEAR_MM 1500          // more clearance than this earns nothing
+#define PLAN_FRONT_DEG 30           // sectors that limit the forward speed
+#define PLAN_BEARING_COST 12        // mm of clearance worth one degree of turn
+#define PLAN_MAX_FORWARD robot.speed
+#define PLAN_MAX_TURN robot.speed
+#define PLAN_TURN_GAIN 3200         // Q8 steps/s per degree, 60 deg ~ full turn
+
+// TRACK CONFIG
+#define TRACK_GAIN 1024             // Q8 1/s, bearing error turned into turn rate
+#define TRACK_EXTRAPOLATE_MS 100    // the bearing rate is followed this far past a frame
+#define TRACK_STALE_MS 250          // without a new frame by then the robot stops
+#define TRACK_MAX_TURN 1500         // steps/s
+
+// GRID CONFIG
+#define GRID_CELLS 128              // per side, a power of two
+#define GRID_CELL_MM 100            // 12.8 m square around the odometry origin
+#define GRID_PRIOR 8                // log-odds nibble of an unknown cell
+#define GRID_HIT 3                  // added where an echo ends
+#define GRID_MISS 1                 // taken from every cell a ray passes
+#define GRID_OCCUPIED 11            // at or above this a cell is an obstacle
+#define GRID_MAX_RANGE_MM 3000      // longer ranges only clear cells
+#define GRID_SYNC_TILES 16          // OP_GRID_TILE frames per OP_GRID_SYNC
+
+// IDLE CONFIG
+#define IDLE_AFTER_MS 10000         // at rest this long before going idle
+#define IDLE_SCAN_MIN_MS 100        // gap between idle sweeps, doubles while
+#define IDLE_SCAN_MAX_MS 800        // nothing moves, below TASK_WDT_TIMEOUT_S
+#define IDLE_MOTION_MM 100          // a range change that resets the gap
+#define IDLE_LIGHT_SLEEP !RADIO_ENABLED // light sleep would drop the WiFi link
+#define IDLE_WAKE_EDGES 3           // RX edges that wake the chip, their bytes are lost
+#define IDLE_WAKE_HOLD_MS 20        // awake after a UART wake for the frame behind it
+#define IDLE_LINK_TIMEOUT_MS 2500   // dead-man window while idle, above the host's
+                                    // 1 s idleKeepalive
+
+// RECORDER CONFIG
+#define REC_RAM_BLOCKS 4            // 4 KB blocks of 255 records in RAM
+#define REC_FLUSH_MS 20             // recorder task poll period
+#define REC_ERASE_AHEAD 16          // blank sectors kept ready for driving
+#define REC_PARTITION_SUBTYPE 0x40  // of the "recorder" data partition, partitions.csv
+#define REC_DUMP_WAIT_MS 200        // a dump frame waits this long for TX room
+
+// TASK CONFIG
+// core 1: Control > Sensor, core 0: LinkRx, RadioRx > Comms > LinkTx,
+// RadioTx > Telemetry > Recorder.
+// Stack sizes are in bytes, telemetry reports what is left of each.
+#define CONTROL_RATE_HZ 1000    // control ticks per second, e.g. 500 or 1000
+#define CONTROL_PRIORITY 20     // below esp_timer (22) and IPC (24)
+#define CONTROL_STACK 4096
+#define SENSOR_PRIORITY 10
+#define SENSOR_STACK 4096
+#define LINK_RX_PRIORITY 6
+#define LINK_RX_STACK 4096
+#define COMMS_PRIORITY 5
+#define COMMS_STACK 4096
+#define LINK_TX_PRIORITY 3
+#define LINK_TX_STACK 3072
+#define RADIO_RX_PRIORITY 6     // UDP only, ESP-NOW receives in the WiFi task
+#define RADIO_RX_STACK 4096
+#define RADIO_TX_PRIORITY 3
+#define RADIO_TX_STACK 3072
+#define TELEMETRY_PRIORITY 2
+#define TELEMETRY_STACK 3072
+#define REC_PRIORITY 1
+#define REC_STACK 3072
+#define TASK_WDT_TIMEOUT_S 1        // Control, Sensor and Comms must check in
+
+// PROFILER CONFIG
+#define PROFILER_ENABLED 1          // 0 compiles every PROFILE() out
+
+// TELEMETRY CONFIG
+#define TELEMETRY_HZ 20             // OP_TELEMETRY frames at boot, 0 = off
+#define TELEMETRY_MAX_HZ 100
+
+// SENSOR CONFIG
+#define SENSOR_GUARD_MS 2
+#define SENSOR_STALE_US 150000              // older echoes are ignored
+
+// RANGE FILTER CONFIG
+#define RANGE_MEDIAN 3
+#define RANGE_EMA_ALPHA 128         // Q8 weight of each new sample
+#define RANGE_OUTLIER_MM 300
+#define RANGE_OUTLIER_CONFIRM 2
+#define RANGE_FAR_MM 4000
+#define RANGE_MIN_CONFIDENCE 96     // readings below this are not acted on
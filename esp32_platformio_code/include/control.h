@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// The control loop is a high priority task on core 1, released every
+// 1/CONTROL_RATE_HZ by hardware timer 0. Keeping it off core 0 keeps it
+// clear of the WiFi/BT stack and the link; the sensor task shares core 1
+// but sits below it and blocks on echoes most of the time.
+
+typedef void (*control_step)();
+
+struct control_stats
+{
+    uint32_t cycles;        // steps run
+    uint32_t overruns;      // periods missed or overrun by a step
+    uint32_t wcet_us;       // longest step since boot
+    uint32_t jitter_max_us; // largest period error since boot
+};
+
+// control_start creates the control task and starts its timer, step runs
+// once per period
+void control_start(control_step step);
+
+// control_resync keeps the next release from counting as jitter, after a
+// light sleep stopped the timer
+void control_resync();
+
+TaskHandle_t control_handle();
+
+const control_stats &control_get_stats();
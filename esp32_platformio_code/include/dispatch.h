@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "link.h"
+#include "protocol.h"
+
+// Host command dispatch, run by the comms task on every batch of frames it
+// takes from the link. State commands (stop, velocity, drive, roam) are
+// coalesced to the newest of the batch and dropped when they repeat the
+// applied one, everything else runs once and in order. Each batch is
+// acknowledged with the seq of its newest frame.
+
+// set by the comms task, the control loop follows it
+extern volatile char roam_en;
+
+// handle_command applies one command of a received frame
+void handle_command(const proto_cmd &cmd, uint8_t seq);
+
+// handle_batch runs every command of a batch of frames in order, except for
+// state commands superseded by a later one in the same batch
+void handle_batch(const link_rx * batch, uint8_t count);
+
+// dispatch_forget_state makes the next state command apply even if it
+// repeats the last one, after the control loop stopped the wheels itself
+void dispatch_forget_state();
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+#include "config.h"
+
+// Differential drive mixing. Positive turn spins the robot the way 'd' did:
+// motor 1 forward, motor 2 backward. When a wheel would exceed max_rate both
+// are scaled by the same factor, so the turn radius survives saturation.
+static inline void drive_mix(int32_t forward, int32_t turn, int32_t max_rate,
+                             int32_t &rate1, int32_t &rate2)
+{
+    int32_t r1 = forward + turn;
+    int32_t r2 = forward - turn;
+    int32_t peak = r1 < 0 ? -r1 : r1;
+    int32_t peak2 = r2 < 0 ? -r2 : r2;
+
+    if (peak2 > peak)
+        peak = peak2;
+    if (peak > max_rate)
+    {
+        r1 = (int64_t)r1 * max_rate / peak;
+        r2 = (int64_t)r2 * max_rate / peak;
+    }
+    rate1 = r1;
+    rate2 = r2;
+}
+
+// wheel steps, one wheel forward and the other backward, per centidegree
+// of spin in place, from the wheel geometry of the robot profile
+static constexpr float steps_per_centideg = robot.wheel_base_mm / 2 * ((float)M_PI / 18000.0f)
+                                            * robot.steps_per_rev / robot.mm_per_rev;
+
+// drive_turn_steps returns the steps each wheel makes, in opposite
+// directions, to spin the robot in place by centideg (clockwise positive,
+// motor 1 forward). Applied to centidegrees/s it gives a turn rate.
+static inline int32_t drive_turn_steps(int32_t centideg)
+{
+    return lroundf(centideg * steps_per_centideg);
+}
+
+// drive_turn_centideg is the inverse, the spin made by turn steps
+static inline int32_t drive_turn_centideg(int32_t steps)
+{
+    return lroundf(steps / steps_per_centideg);
+}
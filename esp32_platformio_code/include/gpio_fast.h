@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <Arduino.h>
+#include <soc/gpio_struct.h>
+
+// Direct writes to the GPIO set/clear registers. One store changes every
+// pin in a mask in the same APB cycle (a set and a clear go out as two
+// stores back to back) and, unlike a read-modify-write of GPIO.out, cannot
+// undo a write from the other core. Pins 0..31 live in the
+// first bank, 32..39 in out1. pinMode still has to configure the pins.
+
+static inline uint32_t gpio_bit(uint8_t pin)
+{
+    return 1u << (pin & 31);
+}
+
+// gpio_fast_write drives the set mask high and then the clear mask low,
+// both masks in the 0..31 bank
+static inline void IRAM_ATTR gpio_fast_write(uint32_t set, uint32_t clear)
+{
+    if (set)
+        GPIO.out_w1ts = set;
+    if (clear)
+        GPIO.out_w1tc = clear;
+}
+
+// gpio_fast_level is the counterpart of digitalWrite for any output pin
+static inline void IRAM_ATTR gpio_fast_level(uint8_t pin, uint8_t level)
+{
+    if (pin < 32)
+    {
+        if (level)
+            GPIO.out_w1ts = gpio_bit(pin);
+        else
+            GPIO.out_w1tc = gpio_bit(pin);
+    } else
+    {
+        if (level)
+            GPIO.out1_w1ts.val = gpio_bit(pin);
+        else
+            GPIO.out1_w1tc.val = gpio_bit(pin);
+    }
+}
+
+// gpio_fast_out returns the level an output pin is currently driven to
+static inline uint8_t IRAM_ATTR gpio_fast_out(uint8_t pin)
+{
+    if (pin < 32)
+        return (GPIO.out >> pin) & 1;
+    return (GPIO.out1.val >> (pin - 32)) & 1;
+}
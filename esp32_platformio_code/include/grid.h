@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "odometry.h"
+#include "range_filter.h"
+
+// Occupancy grid of GRID_CELLS x GRID_CELLS cells of GRID_CELL_MM, centered
+// on the odometry origin, kept in a static arena of 4 bit log-odds cells
+// (two per byte, GRID_PRIOR = unknown). The sensor task is its only writer:
+// every filtered range casts a ray from the dead-reckoned pose along the
+// sonar's bearing, lowering the cells it passes and raising the one it ends
+// in. Cells outside the grid are not kept.
+//
+// For the host the grid is cut into 8 x 8 cell tiles, each change marks
+// its tile dirty and OP_GRID_SYNC sends only the dirty ones.
+
+#define GRID_TILE 8
+#define GRID_TILES ((GRID_CELLS / GRID_TILE) * (GRID_CELLS / GRID_TILE))
+#define GRID_TILE_BYTES (GRID_TILE * GRID_TILE / 2)
+
+#define GRID_SYNC_FULL 0x01     // OP_GRID_SYNC flag: every tile counts as dirty
+#define GRID_SYNC_CLEAR 0x02    // OP_GRID_SYNC flag: forget the map first
+
+// grid_update casts the rays of the sensors in the updated mask
+void grid_update(const pose &p, uint8_t updated, const range_reading * ranges);
+
+// grid_cell returns the log-odds value of the cell holding a point,
+// GRID_PRIOR outside the grid
+uint8_t grid_cell(float x_mm, float y_mm);
+
+// grid_occupied is true for a cell believed occupied
+bool grid_occupied(float x_mm, float y_mm);
+
+// grid_clearance returns the distance from p along angle (radians, like
+// the heading) to the first occupied cell, max_mm if there is none closer
+uint16_t grid_clearance(const pose &p, float angle, uint16_t max_mm);
+
+// grid_limit shortens each sonar's range to a known obstacle on its
+// bearing, so roam avoids what the sonars miss or no longer see
+void grid_limit(const pose &p, range_reading * ranges);
+
+// grid_sync sends up to GRID_SYNC_TILES dirty tiles as OP_GRID_TILE and
+// then an OP_GRID_STATUS with how many are left, the host repeats it until
+// none are
+void grid_sync(uint8_t flags);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+// The trigger is run by a one-shot esp_timer: pull for robot.fire_pulse_ms,
+// release, hold off for robot.fire_rate_ms, repeat for the rest of the burst.
+// Nothing blocks, requests made while a burst is running are ignored.
+
+#define GUN_TRACKING 0x01   // OP_FIRE flag: keep driving while firing
+
+enum gun_state
+{
+    GUN_IDLE,
+    GUN_PULL,
+    GUN_COOLDOWN,
+};
+
+void gun_init();
+
+// gun_fire starts a burst of shots, returns false if one is still running
+bool gun_fire(uint8_t shots);
+
+// gun_safe releases the trigger and drops the rest of any burst
+void gun_safe();
+
+gun_state gun_get_state();
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+// Idle mode. Once the wheels have stood still for IDLE_AFTER_MS with
+// nothing else going on, the drivers are released and the sensor task
+// spaces its sweeps out, from IDLE_SCAN_MIN_MS doubling up to
+// IDLE_SCAN_MAX_MS while the ranges hold still. Between sweeps the chip
+// light sleeps, woken by the timer or by edges on the link UART. The
+// bytes that wake it are lost, so the host leads with a preamble and a
+// short pause while telemetry reports TELEMETRY_MODE_IDLE.
+//
+// Any command ends idle at once, except heartbeats and pings, which only
+// keep the link alive.
+
+// idle_init sets up the wake sources, before the tasks start
+void idle_init();
+
+// idle_run is called by the control loop every tick. busy holds the robot
+// awake for reasons the wheels do not show, roaming or the gun.
+void idle_run(bool busy);
+
+// idle_wake ends idle and restarts the countdown to it, the comms task
+// calls it for every command that changes what the robot does
+void idle_wake();
+
+bool idle_active();
+
+// idle_pause is called by the sensor task after every full sweep. Outside
+// idle it returns at once, in idle it waits out the gap to the next sweep,
+// asleep when it can. moved reports a range that changed by more than
+// IDLE_MOTION_MM since the last sweep.
+void idle_pause(bool moved);
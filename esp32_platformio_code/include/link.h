@@ -0,0 +1,81 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "protocol.h"
+
+// The host link owns LINK_UART (UART0 unless a build moves it) through the
+// ESP-IDF driver. A dedicated RX task
+// sleeps on the driver's event queue, runs the frame parser as soon as
+// bytes land and hands every complete frame to the comms task. Outgoing
+// frames go through a byte ring drained by a TX task, so sending never
+// blocks the caller.
+//
+// Other transports (the radio) hand their frames over through a queue of
+// their own, the comms task takes from all of them alike. Replies and
+// telemetry go out on whichever transport delivered the last frame.
+
+#define LINK_SERIAL 0       // transport of the UART frames
+
+struct link_rx
+{
+    proto_frame frame;
+    int64_t rx_us;          // when the last byte of the frame was parsed
+    uint8_t transport;      // LINK_SERIAL or what link_add_transport returned
+};
+
+// a transport's send takes one complete frame and must not wait
+typedef bool (*link_send_fn)(const uint8_t * frame, size_t len);
+
+struct link_stats
+{
+    uint32_t frames;        // frames handed to the comms task
+    uint32_t dropped;       // frames lost because the command queue was full
+    uint32_t overflows;     // UART FIFO or ring buffer overruns
+    uint32_t baud_fallbacks; // negotiated rates abandoned
+    uint32_t tx_dropped;    // outgoing frames lost to a full TX ring
+    uint32_t latency_us;    // parse -> applied, last frame
+    uint32_t latency_max_us;
+};
+
+// link_init installs the UART driver at rate and starts the RX task. OP_BAUD
+// frames are handled by the link itself and never reach link_receive.
+void link_init(uint32_t rate);
+
+// link_add_transport registers a queue of LINK_FRAME_QUEUE link_rx that
+// link_receive also takes from and returns the transport number its frames
+// must carry, 0 once LINK_TRANSPORTS are in use. Call it after link_init,
+// before frames arrive.
+uint8_t link_add_transport(QueueHandle_t frames, link_send_fn send);
+
+// link_baud returns the rate the link currently runs at
+uint32_t link_baud();
+
+// link_receive waits up to wait ticks for the next frame
+bool link_receive(link_rx &rx, TickType_t wait);
+
+// link_applied records the latency of a frame once it has been acted on
+void link_applied(const link_rx &rx);
+
+// link_send frames a payload of one or more commands and queues it for TX on
+// the transport the host spoke on last. It never waits, a frame that does
+// not fit is dropped and false returned.
+bool link_send(const uint8_t * payload, uint8_t len);
+
+// link_send_wait is link_send waiting up to wait ticks for room in the TX
+// ring, for bulk replies that must not be lost
+bool link_send_wait(const uint8_t * payload, uint8_t len, TickType_t wait);
+
+// link_print writes free text on the UART, the host parser skips it as noise
+void link_print(const char * text);
+
+const link_stats &link_get_stats();
+
+// link_last_frame_us returns micros() when the last valid frame arrived,
+// 0 until the host has been heard at all
+uint32_t link_last_frame_us();
+
+TaskHandle_t link_rx_handle();
+TaskHandle_t link_tx_handle();
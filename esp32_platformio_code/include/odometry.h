@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+// Dead reckoning from the PCNT step totals, integrated at ODOM_HZ on its
+// own timer. Motor 1 is the left wheel and motor 2 the right one, seen
+// from the firmware's forward direction ('w'). Heading is counterclockwise
+// positive, in radians, starting at 0 along +x.
+
+struct pose
+{
+    float x_mm;
+    float y_mm;
+    float heading;
+    uint32_t t_us;      // micros() of the last integration step
+};
+
+// odometry_init starts the integration timer and the OP_POSE reports
+void odometry_init();
+
+// odometry_get refreshes p with the latest pose, safe from any task or core.
+// A read that keeps colliding with the integration step leaves p as it was
+// and returns false, so each caller holds on to its last good pose.
+bool odometry_get(pose &p);
+
+// odometry_set moves the estimate, applied on the next integration step
+void odometry_set(float x_mm, float y_mm, float heading);
+
+// odometry_encode writes the OP_POSE command for p, returns its size
+uint8_t odometry_encode(uint8_t * out, const pose &p);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "range_filter.h"
+#include "ultrasonic.h"
+
+// Reactive roam planner in the spirit of a vector field histogram, cut down
+// to the five sonar bearings. Every sector's clearance is scored against how
+// far it is off the current heading, the robot steers toward the best open
+// sector and slows with the clearance ahead. Only when nothing is open does
+// it spin in place, and it keeps spinning the same way until the front
+// clears so it cannot dither at a wall.
+
+struct planner_config
+{
+    int16_t bearing_deg[SENSOR_COUNT];  // sensor axes, positive = clockwise
+    uint16_t stop_mm;       // sectors nearer than this are blocked
+    uint16_t slow_mm;       // full speed only beyond this
+    uint16_t clear_mm;      // clearance counted at most this far
+    uint8_t front_deg;      // sectors within this set the forward speed
+    uint16_t bearing_cost;  // score lost per degree off the heading, mm
+    uint8_t min_confidence; // weaker readings count as slow_mm
+    int32_t max_forward;    // steps/s
+    int32_t max_turn;       // steps/s
+    int32_t turn_gain;      // steps/s per degree of bearing, Q8
+};
+
+struct planner_output
+{
+    int32_t forward;        // steps/s, see drive.h
+    int32_t turn;
+    char motion;            // 'f' straight, 'l'/'r' steering, 's' spinning
+};
+
+struct planner_state
+{
+    int8_t spin;            // 0, or the direction of the spin in progress
+};
+
+void planner_init(planner_state &s);
+
+planner_output planner_update(planner_state &s, const planner_config &cfg,
+                              const range_reading * ranges);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <xtensa/core-macros.h>
+
+#include "config.h"
+
+// Cycle counter profiler. PROFILE(point) at the top of a scope times the
+// rest of it with the CPU's CCOUNT register, each sample lands in a per
+// point histogram and in a short trace ring. Tables are kept per core so
+// recording takes no lock, ISRs included. With PROFILER_ENABLED 0 the
+// macro compiles to nothing.
+
+enum prof_point
+{
+    PROF_ECHO_ISR,      // echo_capture
+    PROF_ULTRA_TRIG,    // ultra_trig, including its 10 us pulse
+    PROF_RANGE_FILTER,  // filtering one scan slot
+    PROF_PLANNER,       // planner_update
+    PROF_LINK_RX,       // one UART data event through the parser
+    PROF_COMMS,         // handle_batch
+    PROF_CONTROL,       // control_loop
+    PROF_TELEMETRY,     // telemetry_encode
+    PROF_GRID,          // grid rays of one scan slot and grid_limit
+    PROF_POINTS,
+};
+
+#define PROF_BUCKETS 12     // log2 of cycles, bucket 0 is < 128
+#define PROF_TRACE_LEN 64   // events kept per core
+
+#define PROF_DUMP_RESET 0x01    // OP_PROFILE_DUMP flag: clear after the dump
+#define PROF_DUMP_TRACE 0x02    // OP_PROFILE_DUMP flag: send the trace too
+
+struct prof_totals
+{
+    uint32_t count;
+    uint64_t cycles;
+    uint32_t max;       // cycles
+};
+
+void prof_record(uint8_t point, uint32_t start, uint32_t cycles);
+
+// prof_get sums a point's samples over both cores since the last reset
+prof_totals prof_get(uint8_t point);
+
+// prof_dump sends one OP_PROFILE per point that has samples and, with
+// PROF_DUMP_TRACE, the trace rings as OP_TRACE
+void prof_dump(uint8_t flags);
+
+struct prof_scope
+{
+    uint8_t point;
+    uint32_t start;
+
+    explicit prof_scope(uint8_t p) : point(p), start(XTHAL_GET_CCOUNT()) {}
+    ~prof_scope() { prof_record(point, start, XTHAL_GET_CCOUNT() - start); }
+};
+
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+
+#if PROFILER_ENABLED
+#define PROFILE(point) prof_scope PROF_CONCAT(prof_, __LINE__)(point)
+#else
+#define PROFILE(point) ((void)0)
+#endif
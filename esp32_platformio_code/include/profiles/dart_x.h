@@ -0,0 +1,22 @@
+#pragma once
+
+// Sentinel Dart X: five sonars fanned across the front, 43 mm per wheel
+// revolution at 800 steps.
+constexpr robot_profile<5, 3> robot = {
+    // EN, DIR, PUL, forward level; the motors are mirrored
+    {{23, 4, 5, HIGH}, {27, 26, 25, LOW}},
+    // trig, echo, max echo, bearing
+    {
+        {17, 16, 12000, -60},
+        {18, 34, 12000, -30},
+        {19, 35, 25000, 0},
+        {21, 36, 12000, 30},
+        {22, 39, 12000, 60},
+    },
+    // {0, 4}, {2}, {1, 3} fire together
+    {0x11, 0x04, 0x0A},
+
+    33, 1000, 1000,         // gun pin, fire pulse ms, fire rate ms
+    750, 686,               // roam speed, wall limit (4000 us of echo)
+    800, 43.018f, 200.0f,   // steps/rev, mm/rev, wheel base mm
+};
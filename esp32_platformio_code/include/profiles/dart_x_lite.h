@@ -0,0 +1,18 @@
+#pragma once
+
+// Dart X chassis with only the three forward sonars fitted, on the pins of
+// the full build's sensors 1..3.
+constexpr robot_profile<3, 2> robot = {
+    {{23, 4, 5, HIGH}, {27, 26, 25, LOW}},
+    {
+        {18, 34, 12000, -30},
+        {19, 35, 25000, 0},
+        {21, 36, 12000, 30},
+    },
+    // the outer pair together, then the center
+    {0x05, 0x02},
+
+    33, 1000, 1000,         // gun pin, fire pulse ms, fire rate ms
+    750, 686,               // roam speed, wall limit (4000 us of echo)
+    800, 43.018f, 200.0f,   // steps/rev, mm/rev, wheel base mm
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+// Optional WiFi transport next to the serial link, built with -DRADIO_ESPNOW
+// or -DRADIO_UDP. Every datagram carries whole frames in the serial format,
+// they are parsed where they land and queued for the comms task as frames
+// of their own transport (see link_add_transport). Replies go back through
+// a TX ring drained by a TX task so link_send never waits on the radio.
+//
+// The robot has a launcher, so only one peer fixed at build time is heard,
+// datagrams from anyone else are dropped before they are parsed. ESP-NOW
+// takes frames on RADIO_CHANNEL from RADIO_PEER_MAC only, encrypted with
+// RADIO_LMK; on the host side that is an ESP32 bridging ESP-NOW to USB
+// serial (bridge/bridge.cpp, env:espnow_bridge). UDP joins RADIO_SSID, listens on RADIO_UDP_PORT and takes frames
+// from RADIO_PEER_IP only, replying to the port it last sent from. OP_BAUD
+// only means something on the UART.
+//
+// A source address is easy to forge, so every UDP datagram is also
+// authenticated with RADIO_UDP_KEY: it carries a u64 counter, the frames
+// and the first RADIO_UDP_TAG_LEN bytes of an HMAC-SHA256 over both. The
+// robot drops a datagram whose tag does not match or whose counter is not
+// above every one the host used since boot, so a captured one cannot be
+// replayed. The host starts its counter from the wall clock. Nothing is
+// encrypted, which is why UDP is for a trusted network only.
+
+#define RADIO_UDP_COUNTER_LEN 8
+#define RADIO_UDP_TAG_LEN 16
+
+struct radio_stats
+{
+    uint32_t frames;        // frames handed to the comms task
+    uint32_t dropped;       // frames lost because the command queue was full
+    uint32_t bad_packets;   // datagrams without a single valid frame
+    uint32_t foreign;       // datagrams from a sender other than the peer
+    uint32_t bad_tags;      // UDP datagrams failing the tag or replayed
+    uint32_t tx_dropped;    // outgoing frames lost to a full TX ring
+    uint32_t tx_errors;     // frames the radio refused to send
+};
+
+// radio_init brings up WiFi and the transport and registers it with the
+// link, call it after link_init. Without a radio build it does nothing.
+void radio_init();
+
+const radio_stats &radio_get_stats();
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+
+// Rates are kept in Q8 fixed point (1/256 step/s) so the per-tick change
+// stays representable at low accelerations.
+#define RAMP_Q 8
+
+struct ramp_limits
+{
+    int32_t accel;  // max rate change per tick, Q8
+    int32_t jerk;   // max accel change per tick, Q8, 0 = trapezoidal
+};
+
+struct ramp_state
+{
+    int32_t rate;   // current rate, Q8 steps/s
+    int32_t accel;  // rate change applied on the last tick, Q8
+};
+
+// ramp_make_limits converts physical limits into per-tick Q8 values
+static inline ramp_limits ramp_make_limits(uint32_t accel, uint32_t jerk, uint32_t tick_hz)
+{
+    ramp_limits lim;
+    lim.accel = (int32_t)(((uint64_t)accel << RAMP_Q) / tick_hz);
+    lim.jerk = (int32_t)(((uint64_t)jerk << RAMP_Q) / ((uint64_t)tick_hz * tick_hz));
+    if (lim.accel < 1)
+        lim.accel = 1;
+    if (jerk && lim.jerk < 1)
+        lim.jerk = 1;
+    return lim;
+}
+
+static inline uint32_t ramp_isqrt(uint64_t v)
+{
+    uint64_t res = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+
+    while (bit > v)
+        bit >>= 2;
+
+    while (bit)
+    {
+        if (v >= res + bit)
+        {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        } else
+        {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)res;
+}
+
+// ramp_update advances st by one tick towards target (Q8 steps/s).
+// With a jerk limit the acceleration itself is slewed, giving an S-curve;
+// the acceleration is capped so it can always be unwound before the target.
+static inline int32_t ramp_update(ramp_state &st, int32_t target, const ramp_limits &lim)
+{
+    int32_t dv = target - st.rate;
+    int32_t step;
+
+    if (lim.jerk == 0)
+    {
+        step = dv;
+        if (step > lim.accel)
+            step = lim.accel;
+        else if (step < -lim.accel)
+            step = -lim.accel;
+    } else
+    {
+        uint64_t mag_dv = dv < 0 ? -(int64_t)dv : dv;
+        int32_t mag = (int32_t)ramp_isqrt(2 * (uint64_t)lim.jerk * mag_dv);
+        if (mag > lim.accel)
+            mag = lim.accel;
+        step = dv < 0 ? -mag : mag;
+
+        if (step > st.accel + lim.jerk)
+            step = st.accel + lim.jerk;
+        else if (step < st.accel - lim.jerk)
+            step = st.accel - lim.jerk;
+    }
+
+    // land exactly on the target instead of dithering around it
+    if ((dv >= 0 && step >= dv) || (dv <= 0 && step <= dv))
+    {
+        st.rate = target;
+        st.accel = 0;
+    } else
+    {
+        st.rate += step;
+        st.accel = step;
+    }
+    return st.rate;
+}
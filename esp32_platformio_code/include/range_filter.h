@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// Per-sensor distance filter, integer only: a short median window removes
+// single spikes, a jump away from the current estimate has to be seen on
+// RANGE_OUTLIER_CONFIRM samples in a row before it is believed, and an
+// exponential average smooths what is left.
+
+#define RANGE_MEDIAN_MAX 7
+
+struct range_reading
+{
+    uint16_t mm;            // filtered distance
+    uint8_t confidence;     // 0 (no idea) .. 255 (steady echoes)
+};
+
+struct range_filter_config
+{
+    uint8_t median;         // window length, 1..RANGE_MEDIAN_MAX
+    uint16_t alpha;         // weight of a new sample, Q8 (256 = no smoothing)
+    uint16_t outlier_mm;    // jumps above this need confirming
+    uint8_t outlier_confirm;
+    uint16_t far_mm;        // distance reported when nothing is in range
+};
+
+struct range_filter
+{
+    uint16_t window[RANGE_MEDIAN_MAX];
+    uint8_t count;
+    uint8_t next;
+    uint8_t pending;        // consecutive samples disagreeing with state
+    int32_t state;          // smoothed distance, Q4 mm
+    range_reading out;
+};
+
+// echo_to_mm converts a round trip echo time at 343 m/s to millimetres
+static inline uint16_t echo_to_mm(uint32_t echo_us)
+{
+    uint32_t mm = (echo_us * 11239u) >> 16;   // 0.1715 mm/us
+    return mm > 0xFFFF ? 0xFFFF : mm;
+}
+
+void range_filter_init(range_filter &f, const range_filter_config &cfg);
+
+// range_filter_update feeds one sample, status is an echo_status. A missing
+// echo only lowers the confidence.
+range_reading range_filter_update(range_filter &f, const range_filter_config &cfg,
+                                  uint8_t status, uint32_t echo_us);
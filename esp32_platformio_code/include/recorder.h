@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+// Flight recorder. rec_log drops a 16 byte record into a RAM ring of
+// REC_RAM_BLOCKS blocks without taking a lock or waiting, from any task
+// (not from ISRs). A low priority task writes every full block to the
+// "recorder" flash partition as one 4 KB sector, page by page. Sectors are
+// used round robin across the partition, each carrying a sequence number,
+// so every sector wears at the same rate and a reboot carries on after the
+// newest one.
+//
+// Flash writes stall both cores while they run. The task erases sectors
+// ahead while the wheels are still, so in motion it only programs 256 byte
+// pages. It erases in motion only when the RAM ring would overflow.
+// A full ring drops the new records and counts them.
+//
+// OP_RECORDER_DUMP streams the newest blocks oldest first, then the records
+// still in RAM, as OP_RECORD commands and ends with OP_RECORDER_DONE.
+
+enum rec_type
+{
+    REC_NONE,       // an empty slot, never logged
+    REC_SENSOR,     // a sensor, b filtered mm, c echo us, d status | confidence << 8
+    REC_COMMAND,    // a opcode, b frame seq, c and d the first 8 param bytes
+    REC_MODE,       // a telemetry_mode, c and d the commanded wheel rates
+    REC_IDLE,       // a 1 on entering idle, 0 on leaving it
+    REC_FIRE,       // a shots left with this one, trigger pulled
+    REC_BOOT,       // c recorder sectors (0 without the partition), d blocks before this boot
+};
+
+struct rec_record
+{
+    uint32_t t_us;
+    uint8_t type;       // stored last, REC_NONE while the slot is being filled
+    uint8_t a;
+    uint16_t b;
+    int32_t c;
+    int32_t d;
+};
+
+static_assert(sizeof(rec_record) == 16, "records are packed 16 to a flash page row");
+
+// rec_init finds the newest block in flash and starts the recorder task
+void rec_init();
+
+void rec_log(uint8_t type, uint8_t a, uint16_t b, int32_t c, int32_t d);
+
+// rec_dump has the recorder task stream the newest blocks, 0 for all
+void rec_dump(uint16_t blocks);
+
+// rec_dropped returns the records lost to a full RAM ring since boot
+uint32_t rec_dropped();
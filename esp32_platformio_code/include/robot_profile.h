@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <Arduino.h>
+
+// A robot profile describes one chassis: driver and sonar wiring, sonar
+// geometry, the gun and the wheel dimensions. The firmware is built for
+// exactly one, picked by a ROBOT_PROFILE_* flag from the PlatformIO
+// environment. It is all constexpr: pins become immediates, every per
+// sensor loop runs to a compile time count, and a profile that does not
+// fit the hardware fails the build instead of misbehaving on the bench.
+
+struct motor_pins
+{
+    uint8_t en;
+    uint8_t dir;
+    uint8_t pul;
+    uint8_t fwd_level;      // DIR level that drives the wheel forward ('w')
+};
+
+struct sonar
+{
+    uint8_t trig;
+    uint8_t echo;
+    uint32_t max_echo_us;   // longer echoes are out of range
+    int16_t bearing_deg;    // sensor axis, clockwise positive
+};
+
+template <size_t Sensors, size_t Slots>
+struct robot_profile
+{
+    static constexpr size_t sensor_count = Sensors;
+    static constexpr size_t slot_count = Slots;
+
+    motor_pins motors[2];   // motor 1 is the left wheel, motor 2 the right
+    sonar sensors[Sensors];
+    uint8_t slots[Slots];   // sensors fired together, one bitmask per slot
+
+    uint8_t gun;
+    uint32_t fire_pulse_ms; // trigger held low per shot
+    uint32_t fire_rate_ms;  // cooldown between shots
+
+    int32_t speed;          // roam speed, steps/s
+    uint16_t wall_limit_mm; // full roam speed only beyond this
+
+    uint16_t steps_per_rev;
+    float mm_per_rev;       // wheel travel per revolution
+    float wheel_base_mm;    // distance between the wheel contact points
+
+    // EN/DIR and the triggers are written through one register bank
+    constexpr bool pins_in_bank0() const
+    {
+        for (const motor_pins &m : motors)
+            if (m.en >= 32 || m.dir >= 32)
+                return false;
+        for (const sonar &s : sensors)
+            if (s.trig >= 32)
+                return false;
+        return true;
+    }
+
+    // every sensor is fired in exactly one slot
+    constexpr bool slots_cover_sensors() const
+    {
+        uint32_t seen = 0;
+        for (uint8_t mask : slots)
+        {
+            if (seen & mask)
+                return false;
+            seen |= mask;
+        }
+        return seen == (1u << Sensors) - 1;
+    }
+};
+
+// ROBOT_PROFILE_DART_X is the default
+#if defined(ROBOT_PROFILE_DART_X_LITE)
+#include "profiles/dart_x_lite.h"
+#else
+#include "profiles/dart_x.h"
+#endif
+
+static_assert(robot.sensor_count >= 1 && robot.sensor_count <= 5,
+              "the capture units and the telemetry frame take at most five sonars");
+static_assert(robot.pins_in_bank0(), "EN, DIR and trigger pins have to be below GPIO 32");
+static_assert(robot.slots_cover_sensors(), "every sonar has to be in exactly one slot");
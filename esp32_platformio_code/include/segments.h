@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "stepper.h"
+
+// Queued step-exact motion. Each segment moves both wheels by a signed
+// number of steps at a cruise rate. The control loop runs the queue back to
+// back: a wheel that keeps its direction into the next segment carries its
+// speed over, one that stops or reverses brakes and is cut on the exact
+// step by stepper_stop_at. Goals accumulate, so a step overshot in one
+// segment is taken off the next.
+
+#define SEGMENT_DONE 0
+#define SEGMENT_QUEUE_FULL 1    // rejected on arrival
+#define SEGMENT_CANCELLED 2     // dropped by segments_clear
+
+struct segment
+{
+    int32_t steps[STEPPER_COUNT];   // signed, positive = forward
+    uint16_t rate[STEPPER_COUNT];   // cruise rate, steps/s
+    uint16_t id;                    // echoed in OP_SEGMENT_STATUS
+    uint32_t gen;                   // set by segments_push
+};
+
+// segments_push queues a segment, false if the queue is full. Comms task
+// only.
+bool segments_push(segment s);
+
+// segments_clear cancels the running segment and everything queued so far.
+// Any rate set after it returns wins over the queue.
+void segments_clear();
+
+// segments_run advances the queue, called by the control loop each tick
+// before stepper_tick. Every segment finished or cancelled is reported with
+// an OP_SEGMENT_STATUS frame.
+void segments_run();
+
+// segments_free returns how many more segments the queue takes
+uint8_t segments_free();
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Sequence lock for one writer and any number of readers on either core.
+// The writer never waits; a reader that overlaps a write retries, and gives
+// up after a few attempts so a preempted writer cannot stall it. T must be
+// trivially copyable.
+template <typename T>
+class seqlock
+{
+public:
+    void write(const T &value)
+    {
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        data = value;
+        seq.store(s + 2, std::memory_order_release);
+    }
+
+    // try_read copies a consistent snapshot into out, false if nothing has
+    // been written yet or no snapshot was obtained (out is left untouched)
+    bool try_read(T &out, uint8_t attempts = 8) const
+    {
+        while (attempts--)
+        {
+            uint32_t s0 = seq.load(std::memory_order_acquire);
+            if (s0 == 0)
+                return false;
+            if (s0 & 1)
+                continue;
+            T copy = data;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == s0)
+            {
+                out = copy;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // version changes on every write, readers use it to spot new data
+    uint32_t version() const
+    {
+        return seq.load(std::memory_order_acquire) >> 1;
+    }
+
+private:
+    std::atomic<uint32_t> seq{0};
+    T data{};
+};
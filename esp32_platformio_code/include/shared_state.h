@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "planner.h"
+#include "range_filter.h"
+#include "seqlock.h"
+#include "ultrasonic.h"
+
+// State the sensor task (core 1) publishes for the 1 kHz control task (core 1,
+// roams on each new frame) and the telemetry task (core 0). Readers only ever
+// see it through a seqlock snapshot.
+
+struct sensor_frame
+{
+    range_reading ranges[SENSOR_COUNT];
+    uint32_t t_us;      // micros() when the frame was published
+    planner_output plan;    // roam command for these ranges
+};
+
+extern seqlock<sensor_frame> sensor_state;
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Single-producer/single-consumer ring, safe between an ISR and a task or
+// between two cores without locks. N must be a power of two.
+template <typename T, uint32_t N>
+struct spsc_ring
+{
+    static_assert((N & (N - 1)) == 0, "spsc_ring size must be a power of two");
+
+    T items[N];
+    std::atomic<uint32_t> head{0};  // next slot to write, producer only
+    std::atomic<uint32_t> tail{0};  // next slot to read, consumer only
+
+    bool push(const T &item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N)
+            return false;
+        items[h & (N - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+        item = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // peek copies the oldest item without taking it, consumer only
+    bool peek(T &item) const
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+        item = items[t & (N - 1)];
+        return true;
+    }
+
+    uint32_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+// Step pulses are generated by MCPWM unit 0 (timer 0 -> PUL, timer 1 ->
+// PUL2). The control loop calls stepper_tick at STEPPER_TICK_HZ, which only
+// reprograms the frequency along the ramp, the CPU never touches individual
+// steps.
+
+#define STEPPER_COUNT 2
+
+// stepper_init configures the driver pins and the MCPWM timers
+void stepper_init();
+
+// stepper_tick moves both wheels one tick along their ramps
+void stepper_tick();
+
+// stepper_set_rates enables both drivers and ramps each wheel to a signed
+// rate in steps/s (positive = forward), clamped to STEPPER_MAX_RATE
+void stepper_set_rates(int32_t rate1, int32_t rate2);
+
+// stepper_stop ramps both wheels down and releases the drivers once stopped
+void stepper_stop();
+
+// stepper_rate returns the rate a wheel is currently commanded at
+int32_t stepper_rate(uint8_t motor);
+
+// stepper_output_rate returns the signed rate actually on the PUL pin,
+// which lags stepper_rate along the ramp
+int32_t stepper_output_rate(uint8_t motor);
+
+// stepper_steps returns the signed number of steps a wheel has made since
+// boot, counted by PCNT from the emitted pulses
+int32_t stepper_steps(uint8_t motor);
+
+// stepper_set_ramp changes the acceleration (steps/s^2) and jerk
+// (steps/s^3, 0 = trapezoidal) used for all further ramps
+void stepper_set_ramp(uint32_t accel, uint32_t jerk);
+
+// stepper_brake_steps returns a safe number of steps needed to slow from
+// one rate to another under the current ramp limits
+uint32_t stepper_brake_steps(uint32_t from, uint32_t to);
+
+// stepper_stop_at makes a wheel stop exactly on an absolute step count
+// (as returned by stepper_steps). The pulse train is cut by a PCNT
+// threshold interrupt on the goal step, the rate set meanwhile decides how
+// hard that stop is.
+void stepper_stop_at(uint8_t motor, int32_t goal);
+
+// stepper_cancel_goal drops a pending stepper_stop_at
+void stepper_cancel_goal(uint8_t motor);
+
+// stepper_at_goal reports whether a wheel stopped on its last goal
+bool stepper_at_goal(uint8_t motor);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Periodic OP_TELEMETRY frames on the link. A low priority task on core 0
+// samples shared state, builds one frame and queues it with link_send, so
+// a slow or absent host only ever costs dropped telemetry frames.
+
+enum telemetry_loop
+{
+    TELEMETRY_CONTROL,  // one control step
+    TELEMETRY_SCAN,     // one sensor slot, fire to filtered
+    TELEMETRY_JITTER,   // control release against its nominal period
+    TELEMETRY_LOOPS,
+};
+
+enum telemetry_mode
+{
+    TELEMETRY_MODE_HOST,    // wheels follow host commands
+    TELEMETRY_MODE_ROAM,
+    TELEMETRY_MODE_TIMEOUT, // stopped by the link watchdog
+    TELEMETRY_MODE_SEGMENTS,    // wheels run the segment queue
+    TELEMETRY_MODE_TRACK,       // wheels steer onto an extrapolated bearing
+    TELEMETRY_MODE_IDLE,        // at rest, sweeping slowly and sleeping
+};
+
+// telemetry_init starts the telemetry task. The handles of the tasks that
+// main creates are passed in for the stack watermarks, the others are
+// looked up from their modules.
+void telemetry_init(TaskHandle_t comms, TaskHandle_t sensor);
+
+// telemetry_set_rate changes the frame rate, 0 stops the stream
+void telemetry_set_rate(uint8_t hz);
+
+// telemetry_loop_time records how long one pass of a loop took, frames
+// carry the worst pass since the previous frame
+void telemetry_loop_time(telemetry_loop loop, uint32_t us);
+
+void telemetry_set_mode(telemetry_mode mode);
+
+// telemetry_encode writes the OP_TELEMETRY command for the current state and
+// returns its size
+uint8_t telemetry_encode(uint8_t * out);
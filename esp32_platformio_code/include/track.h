@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+// Steering onto a target bearing between camera frames. The host sends the
+// target's bearing and bearing rate once per frame, the control loop
+// extrapolates it at the control rate and takes off what the chassis has
+// turned since, from the step counts. A target that is not refreshed
+// stops being extrapolated after TRACK_EXTRAPOLATE_MS and stops the robot
+// after TRACK_STALE_MS.
+
+// track_set takes a new target, bearings are clockwise positive in
+// centidegrees, rate in centidegrees/s as measured by the camera (so
+// including the chassis' own turning), forward in steps/s. Comms task only.
+void track_set(int16_t bearing, int16_t rate, int16_t forward);
+
+// track_stop hands the wheels back, from any task
+void track_stop();
+
+// track_run steers along the target, called by the control loop each tick
+// before stepper_tick
+void track_run();
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "robot_profile.h"
+
+static constexpr uint8_t SENSOR_COUNT = robot.sensor_count;
+
+// Sensors are fired in slots (robot.slots, one bitmask per slot) rather
+// than all at once so neighbours do not hear each other's bursts. A slot
+// ends when every echo in it is back, or when the longest max_echo_us
+// in it has passed, plus SENSOR_GUARD_MS for the ring-down.
+
+enum echo_status
+{
+    ECHO_NONE,          // never sampled
+    ECHO_OK,            // echo_us holds a fresh pulse width
+    ECHO_OUT_OF_RANGE,  // echo started but ran past the sensor's timeout
+    ECHO_MISSING,       // no echo edge at all, sensor silent
+};
+
+struct echo_sample
+{
+    uint32_t echo_us;   // pulse width, valid for ECHO_OK
+    uint32_t t_us;      // micros() at the trigger
+    uint8_t status;
+};
+
+char init_ultrasonic();
+
+// ultrasonic_scan fires the next slot and blocks until it has finished,
+// returns the mask of sensors that were updated
+uint8_t ultrasonic_scan();
+
+// ultrasonic_sample returns the latest result of a sensor
+echo_sample ultrasonic_sample(uint8_t sensor);
+
+// ultrasonic_fresh is true for an ECHO_OK sample younger than max_age_us
+bool ultrasonic_fresh(const echo_sample &s, uint32_t max_age_us);
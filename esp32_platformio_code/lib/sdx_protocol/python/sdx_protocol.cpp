@@ -0,0 +1,212 @@
+// CPython binding of protocol.h for the host, built by setup.py at the repo
+// root. Inputs are taken through the buffer protocol without a copy and the
+// parser state lives in the Parser object, so feeding bytes only allocates
+// the frames it hands back.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "protocol.h"
+
+struct parser_object
+{
+    PyObject_HEAD
+    proto_parser p;
+};
+
+static PyObject * parser_new(PyTypeObject * type, PyObject * args, PyObject * kwargs)
+{
+    parser_object * self = (parser_object *)type->tp_alloc(type, 0);
+    if (self)
+    {
+        self->p = {};
+        proto_parser_reset(self->p);
+    }
+    return (PyObject *)self;
+}
+
+// Parser.feed(data) -> [(seq, payload), ...] for every valid frame
+// completed by data
+static PyObject * parser_feed(parser_object * self, PyObject * arg)
+{
+    Py_buffer in;
+    if (PyObject_GetBuffer(arg, &in, PyBUF_SIMPLE) < 0)
+        return NULL;
+
+    PyObject * frames = PyList_New(0);
+    const uint8_t * data = (const uint8_t *)in.buf;
+    for (Py_ssize_t i = 0; frames && i < in.len; i++)
+    {
+        if (!proto_feed(self->p, data[i]))
+            continue;
+        PyObject * frame = Py_BuildValue("(By#)", self->p.frame.seq, self->p.frame.payload,
+                                         (Py_ssize_t)self->p.frame.len);
+        if (!frame || PyList_Append(frames, frame) < 0)
+            Py_CLEAR(frames);
+        Py_XDECREF(frame);
+    }
+    PyBuffer_Release(&in);
+    return frames;
+}
+
+static PyObject * parser_reset(parser_object * self, PyObject *)
+{
+    proto_parser_reset(self->p);
+    Py_RETURN_NONE;
+}
+
+static PyObject * parser_stats(parser_object * self, void *)
+{
+    return Py_BuildValue("{s:k,s:k,s:k}", "frames", (unsigned long)self->p.frames,
+                         "crcErrors", (unsigned long)self->p.crc_errors,
+                         "badHeaders", (unsigned long)self->p.bad_headers);
+}
+
+static PyMethodDef parser_methods[] = {
+    {"feed", (PyCFunction)parser_feed, METH_O, "Feeds bytes, returns the (seq, payload) frames they completed."},
+    {"reset", (PyCFunction)parser_reset, METH_NOARGS, "Drops a partly received frame."},
+    {NULL, NULL, 0, NULL},
+};
+
+static PyGetSetDef parser_getset[] = {
+    {"stats", (getter)parser_stats, NULL, "Frame, CRC error and bad header counts.", NULL},
+    {NULL, NULL, NULL, NULL, NULL},
+};
+
+static PyTypeObject parser_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+};
+
+// crc16(data, crc=0xFFFF) -> CRC-16/CCITT-FALSE as used by the frames
+static PyObject * py_crc16(PyObject *, PyObject * args)
+{
+    Py_buffer in;
+    unsigned int crc = 0xFFFF;
+    if (!PyArg_ParseTuple(args, "y*|I", &in, &crc))
+        return NULL;
+    crc = proto_crc16(crc, (const uint8_t *)in.buf, in.len);
+    PyBuffer_Release(&in);
+    return PyLong_FromUnsignedLong(crc);
+}
+
+// frames payload into out, which must hold PROTO_MAX_FRAME bytes, returns
+// the frame size or -1 with a Python error set
+static Py_ssize_t encode(uint8_t * out, unsigned int seq, const Py_buffer &payload)
+{
+    if (payload.len < 1 || payload.len > PROTO_MAX_PAYLOAD)
+    {
+        PyErr_Format(PyExc_ValueError, "payload must be 1..%d bytes", PROTO_MAX_PAYLOAD);
+        return -1;
+    }
+    return proto_encode(out, seq & 0xFF, (const uint8_t *)payload.buf, payload.len);
+}
+
+// encode_frame(seq, payload) -> bytes
+static PyObject * py_encode_frame(PyObject *, PyObject * args)
+{
+    Py_buffer payload;
+    unsigned int seq;
+    if (!PyArg_ParseTuple(args, "Iy*", &seq, &payload))
+        return NULL;
+
+    uint8_t out[PROTO_MAX_FRAME];
+    Py_ssize_t len = encode(out, seq, payload);
+    PyBuffer_Release(&payload);
+    return len < 0 ? NULL : PyBytes_FromStringAndSize((const char *)out, len);
+}
+
+// encode_into(buffer, seq, payload) -> size, frames straight into a
+// writable buffer of at least MAX_FRAME bytes
+static PyObject * py_encode_into(PyObject *, PyObject * args)
+{
+    Py_buffer out, payload;
+    unsigned int seq;
+    if (!PyArg_ParseTuple(args, "w*Iy*", &out, &seq, &payload))
+        return NULL;
+
+    Py_ssize_t len = -1;
+    if (out.len < PROTO_MAX_FRAME)
+        PyErr_Format(PyExc_ValueError, "buffer must hold %d bytes", PROTO_MAX_FRAME);
+    else
+        len = encode((uint8_t *)out.buf, seq, payload);
+    PyBuffer_Release(&out);
+    PyBuffer_Release(&payload);
+    return len < 0 ? NULL : PyLong_FromSsize_t(len);
+}
+
+// opcodes() -> {name: opcode}
+static PyObject * py_opcodes(PyObject *, PyObject *)
+{
+    PyObject * ops = PyDict_New();
+    for (const proto_op &op : proto_ops)
+    {
+        PyObject * code = PyLong_FromLong(op.opcode);
+        if (!code || PyDict_SetItemString(ops, op.name, code) < 0)
+            Py_CLEAR(ops);
+        Py_XDECREF(code);
+        if (!ops)
+            break;
+    }
+    return ops;
+}
+
+// param_formats() -> {opcode: struct format}, little endian
+static PyObject * py_param_formats(PyObject *, PyObject *)
+{
+    PyObject * formats = PyDict_New();
+    for (const proto_op &op : proto_ops)
+    {
+        PyObject * code = PyLong_FromLong(op.opcode);
+        PyObject * format = PyUnicode_FromFormat("<%s", op.params);
+        if (!code || !format || PyDict_SetItem(formats, code, format) < 0)
+            Py_CLEAR(formats);
+        Py_XDECREF(code);
+        Py_XDECREF(format);
+        if (!formats)
+            break;
+    }
+    return formats;
+}
+
+static PyMethodDef module_methods[] = {
+    {"crc16", py_crc16, METH_VARARGS, "CRC-16/CCITT-FALSE of data."},
+    {"encode_frame", py_encode_frame, METH_VARARGS, "Frames a payload, returns the frame bytes."},
+    {"encode_into", py_encode_into, METH_VARARGS, "Frames a payload into a writable buffer, returns its size."},
+    {"opcodes", py_opcodes, METH_NOARGS, "Opcode of every command by name."},
+    {"param_formats", py_param_formats, METH_NOARGS, "struct format of every opcode's parameters."},
+    {NULL, NULL, 0, NULL},
+};
+
+static PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT, "sdx_protocol", "Robot link codec, built from protocol.h.", -1, module_methods,
+};
+
+PyMODINIT_FUNC PyInit_sdx_protocol()
+{
+    parser_type.tp_name = "sdx_protocol.Parser";
+    parser_type.tp_doc = "Incremental frame parser.";
+    parser_type.tp_basicsize = sizeof(parser_object);
+    parser_type.tp_flags = Py_TPFLAGS_DEFAULT;
+    parser_type.tp_new = parser_new;
+    parser_type.tp_methods = parser_methods;
+    parser_type.tp_getset = parser_getset;
+    if (PyType_Ready(&parser_type) < 0)
+        return NULL;
+
+    PyObject * m = PyModule_Create(&module_def);
+    if (!m)
+        return NULL;
+
+    Py_INCREF(&parser_type);
+    if (PyModule_AddObject(m, "Parser", (PyObject *)&parser_type) < 0
+        || PyModule_AddIntConstant(m, "SYNC", PROTO_SYNC) < 0
+        || PyModule_AddIntConstant(m, "VERSION", PROTO_VERSION) < 0
+        || PyModule_AddIntConstant(m, "MAX_PAYLOAD", PROTO_MAX_PAYLOAD) < 0
+        || PyModule_AddIntConstant(m, "MAX_FRAME", PROTO_MAX_FRAME) < 0)
+    {
+        Py_DECREF(&parser_type);
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Wire format of the robot link, all fields little endian. Header only: the
+// firmware compiles it directly and the host's sdx_protocol Python module
+// (setup.py at the repo root) is built from this same file.
+//
+//   0      SYNC     0xA5
+//   1      VER      PROTO_VERSION
+//   2      SEQ      frame sequence number
+//   3      LEN      payload length, at most PROTO_MAX_PAYLOAD
+//   4..    PAYLOAD  one or more commands, each an opcode plus fixed params
+//   4+LEN  CRC      CRC-16/CCITT-FALSE over VER..PAYLOAD
+//
+// The same framing is used in both directions.
+
+#define PROTO_SYNC 0xA5
+#define PROTO_VERSION 1
+#define PROTO_HEADER_LEN 4
+#define PROTO_CRC_LEN 2
+#define PROTO_MAX_PAYLOAD 64
+#define PROTO_MAX_FRAME (PROTO_HEADER_LEN + PROTO_MAX_PAYLOAD + PROTO_CRC_LEN)
+
+// host -> robot
+#define OP_STOP 0x01        // -
+#define OP_VELOCITY 0x02    // i16 rate1, i16 rate2 (steps/s per wheel)
+#define OP_ROAM 0x03        // -
+#define OP_FIRE 0x04        // u8 shots, u8 flags
+#define OP_PING 0x05        // u32 token
+#define OP_BAUD 0x06        // u32 baud, must be the only command in its frame
+#define OP_DRIVE 0x07       // i16 forward, i16 turn (steps/s, see drive.h)
+#define OP_SET_POSE 0x08    // i32 x mm, i32 y mm, i16 heading centidegrees
+#define OP_TELEMETRY_RATE 0x09  // u8 frames/s, 0 = off
+#define OP_HEARTBEAT 0x0A   // -, keeps the link watchdog fed
+#define OP_PROFILE_DUMP 0x0B    // u8 flags (profiler.h)
+#define OP_SEGMENT 0x0C     // i32 steps1, i32 steps2, u16 rate1, u16 rate2, u16 id
+                            // (segments.h)
+#define OP_ROTATE 0x0D      // i16 centidegrees clockwise, u16 rate, u16 id, spins
+                            // in place as one segment, replacing the queue
+#define OP_TRACK 0x0E       // i16 bearing centidegrees, i16 bearing rate centidegrees/s
+                            // (clockwise, as seen by the camera), i16 forward (track.h)
+#define OP_GRID_SYNC 0x0F   // u8 flags (grid.h), sends the dirty occupancy tiles
+#define OP_RECORDER_DUMP 0x10   // u16 newest blocks to send, 0 = all (recorder.h)
+
+// robot -> host
+#define OP_PONG 0x81        // u32 token
+#define OP_BAUD_ACK 0x82    // u32 baud about to be used, 0 = refused
+#define OP_POSE 0x83        // i32 x mm, i32 y mm, i16 heading centidegrees
+#define OP_TELEMETRY 0x84   // see below
+#define OP_ACK 0x85         // u8 seq of the newest frame applied
+#define OP_PROFILE 0x86     // u8 point, u32 count, u32 total_us, u32 max_cycles,
+                            // u16 buckets[12] (log2 cycles from < 128 up)
+#define OP_TRACE 0x87       // u8 core, u8 point, u32 start ccount, u32 cycles
+#define OP_SEGMENT_STATUS 0x88  // u16 id, u8 status (segments.h), u8 free slots
+#define OP_GRID_TILE 0x89   // u8 tile, u8 cells[32] (8 x 8 log-odds nibbles, row by
+                            // row, the even cell in the low nibble; grid.h)
+#define OP_GRID_STATUS 0x8A // u16 dirty tiles left, u16 cells per side, u16 cell mm
+#define OP_RECORD 0x8B      // u32 index, u32 t_us, u8 type, u8 a, u16 b, i32 c, i32 d
+                            // (recorder.h)
+#define OP_RECORDER_DONE 0x8C   // u32 records sent, u32 records dropped since boot
+#define PROFILE_LEN 37
+#define TRACE_LEN 10
+#define RECORD_LEN 20
+
+// OP_TELEMETRY params, TELEMETRY_LEN bytes:
+//   u32 t_ms, u16 range_mm[5], u8 confidence[5], u8 mode, u8 plan motion,
+//   i16 step_rate[2] (emitted, steps/s), u8 gun_state,
+//   u16 control_us, u16 scan_us, u16 jitter_us (worst since the last frame),
+//   u16 control_wcet_us, u32 control_overruns (since boot),
+//   u32 free_heap, u16 stack_free[6] (control, comms, sensor, link rx,
+//   link tx, telemetry; bytes)
+#define TELEMETRY_LEN 54
+#define TELEMETRY_SENSORS 5
+
+// Parameter layout of every opcode in Python struct notation minus the
+// byte order: b/B 8 bit, h/H 16 bit, i/I 32 bit, a count repeats the next
+// code. The parser's parameter sizes and the host's decoders both come
+// from this table, so a new opcode only needs its line here.
+struct proto_op
+{
+    uint8_t opcode;
+    const char * name;
+    const char * params;
+};
+
+static constexpr proto_op proto_ops[] = {
+    {OP_STOP, "STOP", ""},
+    {OP_VELOCITY, "VELOCITY", "hh"},
+    {OP_ROAM, "ROAM", ""},
+    {OP_FIRE, "FIRE", "BB"},
+    {OP_PING, "PING", "I"},
+    {OP_BAUD, "BAUD", "I"},
+    {OP_DRIVE, "DRIVE", "hh"},
+    {OP_SET_POSE, "SET_POSE", "iih"},
+    {OP_TELEMETRY_RATE, "TELEMETRY_RATE", "B"},
+    {OP_HEARTBEAT, "HEARTBEAT", ""},
+    {OP_PROFILE_DUMP, "PROFILE_DUMP", "B"},
+    {OP_SEGMENT, "SEGMENT", "iiHHH"},
+    {OP_ROTATE, "ROTATE", "hHH"},
+    {OP_TRACK, "TRACK", "hhh"},
+    {OP_GRID_SYNC, "GRID_SYNC", "B"},
+    {OP_RECORDER_DUMP, "RECORDER_DUMP", "H"},
+    {OP_PONG, "PONG", "I"},
+    {OP_BAUD_ACK, "BAUD_ACK", "I"},
+    {OP_POSE, "POSE", "iih"},
+    {OP_TELEMETRY, "TELEMETRY", "I5H5BBBhhBHHHHII6H"},
+    {OP_ACK, "ACK", "B"},
+    {OP_PROFILE, "PROFILE", "BIII12H"},
+    {OP_TRACE, "TRACE", "BBII"},
+    {OP_SEGMENT_STATUS, "SEGMENT_STATUS", "HBB"},
+    {OP_GRID_TILE, "GRID_TILE", "B32B"},
+    {OP_GRID_STATUS, "GRID_STATUS", "HHH"},
+    {OP_RECORD, "RECORD", "IIBBHii"},
+    {OP_RECORDER_DONE, "RECORDER_DONE", "II"},
+};
+
+// proto_format_len returns the size of a parameter layout, -1 if it holds
+// a code outside the table above
+constexpr int proto_format_len(const char * f)
+{
+    int len = 0;
+    while (*f)
+    {
+        int count = 0;
+        while (*f >= '0' && *f <= '9')
+            count = count * 10 + (*f++ - '0');
+        if (!count)
+            count = 1;
+
+        switch (*f++) {
+            case 'b':
+            case 'B':
+                len += count;
+                break;
+            case 'h':
+            case 'H':
+                len += 2 * count;
+                break;
+            case 'i':
+            case 'I':
+                len += 4 * count;
+                break;
+            default:
+                return -1;
+        }
+    }
+    return len;
+}
+
+struct proto_len_table
+{
+    int8_t len[256];
+};
+
+constexpr proto_len_table proto_make_len_table()
+{
+    proto_len_table t = {};
+    for (int i = 0; i < 256; i++)
+        t.len[i] = -1;
+    for (const proto_op &op : proto_ops)
+        t.len[op.opcode] = proto_format_len(op.params);
+    return t;
+}
+
+// indexed by opcode, -1 for unknown ones
+inline constexpr proto_len_table proto_param_lens = proto_make_len_table();
+
+static_assert(proto_param_lens.len[OP_TELEMETRY] == TELEMETRY_LEN, "OP_TELEMETRY layout");
+static_assert(proto_param_lens.len[OP_PROFILE] == PROFILE_LEN, "OP_PROFILE layout");
+static_assert(proto_param_lens.len[OP_TRACE] == TRACE_LEN, "OP_TRACE layout");
+static_assert(proto_param_lens.len[OP_RECORD] == RECORD_LEN, "OP_RECORD layout");
+static_assert(proto_param_lens.len[0] == -1, "opcode 0 is never used");
+
+struct proto_frame
+{
+    uint8_t version;
+    uint8_t seq;
+    uint8_t len;
+    uint8_t payload[PROTO_MAX_PAYLOAD];
+};
+
+struct proto_cmd
+{
+    uint8_t opcode;
+    const uint8_t * params;
+};
+
+struct proto_parser
+{
+    uint8_t state;
+    uint8_t pos;
+    uint16_t crc;
+    proto_frame frame;
+
+    uint32_t frames;        // valid frames received
+    uint32_t crc_errors;    // frames dropped on a CRC mismatch
+    uint32_t bad_headers;   // frames dropped on version or length
+};
+
+static inline int16_t proto_get_i16(const uint8_t * p)
+{
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint16_t proto_get_u16(const uint8_t * p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t proto_get_u32(const uint8_t * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint8_t * proto_put_u16(uint8_t * p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static inline uint8_t * proto_put_u32(uint8_t * p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+enum
+{
+    PROTO_RX_SYNC,
+    PROTO_RX_VERSION,
+    PROTO_RX_SEQ,
+    PROTO_RX_LEN,
+    PROTO_RX_PAYLOAD,
+    PROTO_RX_CRC_LO,
+    PROTO_RX_CRC_HI,
+};
+
+inline uint16_t proto_crc16(uint16_t crc, const uint8_t * data, size_t len)
+{
+    while (len--)
+    {
+        crc ^= (uint16_t)*data++ << 8;
+        for (uint8_t i = 0; i < 8; i++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+inline void proto_parser_reset(proto_parser &p)
+{
+    p.state = PROTO_RX_SYNC;
+    p.pos = 0;
+    p.crc = 0xFFFF;
+}
+
+// proto_feed consumes one byte and returns true once p.frame holds a
+// complete frame with a valid CRC. It never blocks.
+inline bool proto_feed(proto_parser &p, uint8_t byte)
+{
+    switch (p.state) {
+        case PROTO_RX_SYNC:
+            if (byte == PROTO_SYNC)
+            {
+                p.crc = 0xFFFF;
+                p.state = PROTO_RX_VERSION;
+            }
+            break;
+        case PROTO_RX_VERSION:
+            if (byte != PROTO_VERSION)
+            {
+                p.bad_headers++;
+                p.state = byte == PROTO_SYNC ? PROTO_RX_VERSION : PROTO_RX_SYNC;
+                break;
+            }
+            p.frame.version = byte;
+            p.crc = proto_crc16(p.crc, &byte, 1);
+            p.state = PROTO_RX_SEQ;
+            break;
+        case PROTO_RX_SEQ:
+            p.frame.seq = byte;
+            p.crc = proto_crc16(p.crc, &byte, 1);
+            p.state = PROTO_RX_LEN;
+            break;
+        case PROTO_RX_LEN:
+            if (byte == 0 || byte > PROTO_MAX_PAYLOAD)
+            {
+                p.bad_headers++;
+                p.state = PROTO_RX_SYNC;
+                break;
+            }
+            p.frame.len = byte;
+            p.crc = proto_crc16(p.crc, &byte, 1);
+            p.pos = 0;
+            p.state = PROTO_RX_PAYLOAD;
+            break;
+        case PROTO_RX_PAYLOAD:
+            p.frame.payload[p.pos++] = byte;
+            if (p.pos == p.frame.len)
+            {
+                p.crc = proto_crc16(p.crc, p.frame.payload, p.frame.len);
+                p.state = PROTO_RX_CRC_LO;
+            }
+            break;
+        case PROTO_RX_CRC_LO:
+            p.pos = byte;
+            p.state = PROTO_RX_CRC_HI;
+            break;
+        case PROTO_RX_CRC_HI:
+            p.state = PROTO_RX_SYNC;
+            if ((uint16_t)(p.pos | (byte << 8)) != p.crc)
+            {
+                p.crc_errors++;
+                break;
+            }
+            p.frames++;
+            return true;
+    }
+    return false;
+}
+
+// proto_param_len returns the parameter size of an opcode, -1 if unknown
+inline int proto_param_len(uint8_t opcode)
+{
+    return proto_param_lens.len[opcode];
+}
+
+// proto_next_cmd walks the commands of a frame, offset starts at 0. It stops
+// at the end of the payload or at the first unknown or truncated command.
+inline bool proto_next_cmd(const proto_frame &f, uint8_t &offset, proto_cmd &cmd)
+{
+    if (offset >= f.len)
+        return false;
+
+    int len = proto_param_len(f.payload[offset]);
+    if (len < 0 || offset + 1 + len > f.len)
+    {
+        offset = f.len;
+        return false;
+    }
+
+    cmd.opcode = f.payload[offset];
+    cmd.params = &f.payload[offset + 1];
+    offset += 1 + len;
+    return true;
+}
+
+// proto_encode writes a full frame to out (PROTO_MAX_FRAME bytes) and
+// returns its size
+inline size_t proto_encode(uint8_t * out, uint8_t seq, const uint8_t * payload, uint8_t len)
+{
+    out[0] = PROTO_SYNC;
+    out[1] = PROTO_VERSION;
+    out[2] = seq;
+    out[3] = len;
+    for (uint8_t i = 0; i < len; i++)
+        out[PROTO_HEADER_LEN + i] = payload[i];
+
+    uint16_t crc = proto_crc16(0xFFFF, &out[1], PROTO_HEADER_LEN - 1 + len);
+    proto_put_u16(&out[PROTO_HEADER_LEN + len], crc);
+    return PROTO_HEADER_LEN + len + PROTO_CRC_LEN;
+}
@@ -0,0 +1,85 @@
+#include <Arduino.h>
+#include <esp_task_wdt.h>
+
+#include "config.h"
+#include "control.h"
+#include "telemetry.h"
+
+static TaskHandle_t task;
+static hw_timer_t * timer;
+static control_step step_fn;
+static control_stats stats;
+static volatile bool resync = false;
+
+static void IRAM_ATTR control_isr()
+{
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void control_task(void * parameter)
+{
+    const uint32_t period = 1000000 / CONTROL_RATE_HZ;
+    uint32_t last = 0;
+
+    esp_task_wdt_add(NULL);
+    while (1)
+    {
+        // more than one pending release means whole periods were missed,
+        // they are counted but only run once
+        uint32_t pending = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t start = micros();
+
+        if (pending > 1)
+            stats.overruns += pending - 1;
+        if (stats.cycles && !resync)
+        {
+            int32_t error = (int32_t)(start - last - period * pending);
+            uint32_t jitter = error < 0 ? -error : error;
+            if (jitter > stats.jitter_max_us)
+                stats.jitter_max_us = jitter;
+            telemetry_loop_time(TELEMETRY_JITTER, jitter);
+        }
+        last = start;
+        resync = false;
+
+        step_fn();
+
+        uint32_t took = micros() - start;
+        if (took > period)
+            stats.overruns++;
+        if (took > stats.wcet_us)
+            stats.wcet_us = took;
+        stats.cycles++;
+        telemetry_loop_time(TELEMETRY_CONTROL, took);
+        esp_task_wdt_reset();
+    }
+}
+
+void control_start(control_step step)
+{
+    step_fn = step;
+    xTaskCreatePinnedToCore(control_task, "Control", CONTROL_STACK, NULL, CONTROL_PRIORITY, &task, 1);
+
+    // 80 MHz APB / 80 = 1 MHz timer clock
+    timer = timerBegin(0, 80, true);
+    timerAttachInterrupt(timer, control_isr, true);
+    timerAlarmWrite(timer, 1000000 / CONTROL_RATE_HZ, true);
+    timerAlarmEnable(timer);
+}
+
+void control_resync()
+{
+    resync = true;
+}
+
+TaskHandle_t control_handle()
+{
+    return task;
+}
+
+const control_stats &control_get_stats()
+{
+    return stats;
+}
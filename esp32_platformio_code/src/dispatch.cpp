@@ -0,0 +1,237 @@
+#include <math.h>
+#include <string.h>
+
+#include "config.h"
+#include "dispatch.h"
+#include "drive.h"
+#include "grid.h"
+#include "gun.h"
+#include "idle.h"
+#include "link.h"
+#include "odometry.h"
+#include "profiler.h"
+#include "protocol.h"
+#include "recorder.h"
+#include "segments.h"
+#include "stepper.h"
+#include "telemetry.h"
+#include "track.h"
+
+volatile char roam_en = '0';
+
+// only the comms task touches this: the state command last applied, so a
+// repeat of it costs nothing
+static uint8_t applied_state[1 + 4];
+
+// State commands (stop, velocity, drive, roam) each replace the whole motion
+// state, so only the newest one matters and repeating it is harmless. The
+// host streams them every frame; everything else is an event and runs
+// exactly once, in order.
+static bool is_state(uint8_t opcode)
+{
+    return opcode == OP_STOP || opcode == OP_VELOCITY || opcode == OP_DRIVE || opcode == OP_ROAM;
+}
+
+// state_changed records cmd as the applied state, false if it already was
+static bool state_changed(const proto_cmd &cmd)
+{
+    uint8_t len = 1 + proto_param_len(cmd.opcode);
+    if (applied_state[0] == cmd.opcode && memcmp(&applied_state[1], cmd.params, len - 1) == 0)
+        return false;
+    applied_state[0] = cmd.opcode;
+    memcpy(&applied_state[1], cmd.params, len - 1);
+    return true;
+}
+
+// queue_segment hands a move to the segment queue, the wheels leave the
+// applied state for it. A full queue refuses the move right here.
+static void queue_segment(segment &s)
+{
+    roam_en = '0';
+    applied_state[0] = 0;
+    track_stop();
+    telemetry_set_mode(TELEMETRY_MODE_SEGMENTS);
+    if (segments_push(s))
+        return;
+
+    uint8_t reply[1 + 4] = {OP_SEGMENT_STATUS};
+    uint8_t * p = proto_put_u16(&reply[1], s.id);
+    *p++ = SEGMENT_QUEUE_FULL;
+    *p = 0;
+    link_send(reply, sizeof(reply));
+}
+
+// record_command logs a command with the first 8 bytes of its parameters
+static void record_command(const proto_cmd &cmd, uint8_t seq)
+{
+    int32_t words[2] = {0, 0};
+    int len = proto_param_len(cmd.opcode);
+    memcpy(words, cmd.params, len < (int)sizeof(words) ? len : sizeof(words));
+    rec_log(REC_COMMAND, cmd.opcode, seq, words[0], words[1]);
+}
+
+void handle_command(const proto_cmd &cmd, uint8_t seq)
+{
+    if (is_state(cmd.opcode) && !state_changed(cmd))
+        return;
+
+    if (cmd.opcode != OP_HEARTBEAT)
+        record_command(cmd, seq);
+
+    // keepalives leave an idle robot asleep, anything else wakes it
+    if (cmd.opcode != OP_HEARTBEAT && cmd.opcode != OP_PING)
+        idle_wake();
+
+    switch (cmd.opcode) {
+        case OP_VELOCITY:
+            segments_clear();
+            track_stop();
+            roam_en = '0';
+            telemetry_set_mode(TELEMETRY_MODE_HOST);
+            stepper_set_rates(proto_get_i16(cmd.params), proto_get_i16(cmd.params + 2));
+            break;
+        case OP_DRIVE:
+        {
+            int32_t rate1, rate2;
+            segments_clear();
+            track_stop();
+            roam_en = '0';
+            telemetry_set_mode(TELEMETRY_MODE_HOST);
+            drive_mix(proto_get_i16(cmd.params), proto_get_i16(cmd.params + 2), STEPPER_MAX_RATE, rate1, rate2);
+            stepper_set_rates(rate1, rate2);
+            break;
+        }
+        case OP_FIRE:
+            // firing the gun, the wheels stop unless we fire while tracking,
+            // then whatever drives them (and the mode) carries on
+            if (!(cmd.params[1] & GUN_TRACKING))
+            {
+                roam_en = '0';
+                telemetry_set_mode(TELEMETRY_MODE_HOST);
+                // the wheels no longer follow the applied state
+                applied_state[0] = 0;
+                segments_clear();
+                track_stop();
+                stepper_stop();
+            }
+            gun_fire(cmd.params[0]);
+            break;
+        case OP_ROAM:
+            segments_clear();
+            track_stop();
+            roam_en = '1';
+            telemetry_set_mode(TELEMETRY_MODE_ROAM);
+            break;
+        case OP_STOP:
+            segments_clear();
+            track_stop();
+            roam_en = '0';
+            telemetry_set_mode(TELEMETRY_MODE_HOST);
+            stepper_stop();
+            break;
+        case OP_SEGMENT:
+        {
+            segment s;
+            s.steps[0] = (int32_t)proto_get_u32(cmd.params);
+            s.steps[1] = (int32_t)proto_get_u32(cmd.params + 4);
+            s.rate[0] = proto_get_u16(cmd.params + 8);
+            s.rate[1] = proto_get_u16(cmd.params + 10);
+            s.id = proto_get_u16(cmd.params + 12);
+            queue_segment(s);
+            break;
+        }
+        case OP_ROTATE:
+        {
+            // an aim correction is only useful from where the robot is now,
+            // so it replaces whatever was still queued
+            segment s;
+            int32_t steps = drive_turn_steps(proto_get_i16(cmd.params));
+            segments_clear();
+            s.steps[0] = steps;
+            s.steps[1] = -steps;
+            s.rate[0] = s.rate[1] = proto_get_u16(cmd.params + 2);
+            s.id = proto_get_u16(cmd.params + 4);
+            queue_segment(s);
+            break;
+        }
+        case OP_TRACK:
+            // an event rather than state: every frame restarts the
+            // extrapolation, even one with the same bearing
+            segments_clear();
+            roam_en = '0';
+            applied_state[0] = 0;
+            telemetry_set_mode(TELEMETRY_MODE_TRACK);
+            track_set(proto_get_i16(cmd.params), proto_get_i16(cmd.params + 2), proto_get_i16(cmd.params + 4));
+            break;
+        case OP_SET_POSE:
+            odometry_set((int32_t)proto_get_u32(cmd.params), (int32_t)proto_get_u32(cmd.params + 4),
+                         proto_get_i16(cmd.params + 8) * ((float)M_PI / 18000.0f));
+            break;
+        case OP_TELEMETRY_RATE:
+            telemetry_set_rate(cmd.params[0]);
+            break;
+        case OP_PROFILE_DUMP:
+            prof_dump(cmd.params[0]);
+            break;
+        case OP_GRID_SYNC:
+            grid_sync(cmd.params[0]);
+            break;
+        case OP_RECORDER_DUMP:
+            rec_dump(proto_get_u16(cmd.params));
+            break;
+        case OP_PING:
+        {
+            uint8_t reply[1 + 4] = {OP_PONG};
+            proto_put_u32(&reply[1], proto_get_u32(cmd.params));
+            link_send(reply, sizeof(reply));
+            break;
+        }
+    }
+}
+
+struct cmd_pos
+{
+    uint8_t frame;
+    uint8_t offset;
+};
+
+void handle_batch(const link_rx * batch, uint8_t count)
+{
+    PROFILE(PROF_COMMS);
+    proto_cmd cmd;
+    cmd_pos newest = {0xFF, 0};
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t offset = 0;
+        uint8_t at = 0;
+        while (proto_next_cmd(batch[i].frame, offset, cmd))
+        {
+            if (is_state(cmd.opcode))
+                newest = {i, at};
+            at = offset;
+        }
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t offset = 0;
+        uint8_t at = 0;
+        while (proto_next_cmd(batch[i].frame, offset, cmd))
+        {
+            if (!is_state(cmd.opcode) || (newest.frame == i && newest.offset == at))
+                handle_command(cmd, batch[i].frame.seq);
+            at = offset;
+        }
+        link_applied(batch[i]);
+    }
+
+    // acknowledges everything up to the newest frame of the batch
+    uint8_t ack[1 + 1] = {OP_ACK, batch[count - 1].frame.seq};
+    link_send(ack, sizeof(ack));
+}
+
+void dispatch_forget_state()
+{
+    applied_state[0] = 0;
+}
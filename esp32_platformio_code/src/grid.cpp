@@ -0,0 +1,199 @@
+#include <Arduino.h>
+#include <math.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "grid.h"
+#include "link.h"
+#include "protocol.h"
+#include "ultrasonic.h"
+
+static_assert((GRID_CELLS & (GRID_CELLS - 1)) == 0 && GRID_CELLS % GRID_TILE == 0,
+              "GRID_CELLS has to be a power of two of whole tiles");
+static_assert(GRID_TILES <= 256, "tile numbers are sent as one byte");
+
+static uint8_t cells[GRID_CELLS * GRID_CELLS / 2];
+static std::atomic<uint32_t> dirty[GRID_TILES / 32];
+static std::atomic<bool> clear_requested{true};    // also fills the prior at boot
+
+// only the comms task touches this, sync resumes where the last one stopped
+static uint16_t next_tile = 0;
+
+static constexpr float step_mm = GRID_CELL_MM / 2.0f;
+
+static bool to_cell(float x_mm, float y_mm, int32_t &cx, int32_t &cy)
+{
+    cx = (int32_t)floorf(x_mm / GRID_CELL_MM) + GRID_CELLS / 2;
+    cy = (int32_t)floorf(y_mm / GRID_CELL_MM) + GRID_CELLS / 2;
+    return cx >= 0 && cx < GRID_CELLS && cy >= 0 && cy < GRID_CELLS;
+}
+
+static uint8_t get(int32_t cx, int32_t cy)
+{
+    uint32_t i = cy * GRID_CELLS + cx;
+    return (cells[i >> 1] >> ((i & 1) * 4)) & 0x0F;
+}
+
+static void mark_dirty(uint16_t tile)
+{
+    dirty[tile / 32].fetch_or(1u << (tile % 32));
+}
+
+static void mark_all_dirty()
+{
+    for (std::atomic<uint32_t> &d : dirty)
+        d = 0xFFFFFFFF;
+}
+
+// adjust moves one cell's log-odds by delta, clamped to a nibble
+static void adjust(int32_t cx, int32_t cy, int8_t delta)
+{
+    uint32_t i = cy * GRID_CELLS + cx;
+    uint8_t shift = (i & 1) * 4;
+    int8_t old = (cells[i >> 1] >> shift) & 0x0F;
+    int8_t v = old + delta;
+    v = v < 0 ? 0 : v > 15 ? 15 : v;
+    if (v == old)
+        return;
+    cells[i >> 1] = (cells[i >> 1] & ~(0x0F << shift)) | (v << shift);
+    mark_dirty((cy / GRID_TILE) * (GRID_CELLS / GRID_TILE) + cx / GRID_TILE);
+}
+
+// cast walks a ray in half cell steps, lowering every cell it passes and
+// raising the one it ends in on a hit
+static void cast(const pose &p, float angle, uint16_t mm, bool hit)
+{
+    float dx = cosf(angle) * step_mm;
+    float dy = sinf(angle) * step_mm;
+    int32_t n = mm / step_mm;
+    int32_t last_x = -1, last_y = -1;
+
+    for (int32_t k = 0; k < n; k++)
+    {
+        int32_t cx, cy;
+        if (!to_cell(p.x_mm + dx * k, p.y_mm + dy * k, cx, cy))
+            return;
+        if (cx == last_x && cy == last_y)
+            continue;
+        last_x = cx;
+        last_y = cy;
+        adjust(cx, cy, -GRID_MISS);
+    }
+
+    int32_t cx, cy;
+    if (hit && to_cell(p.x_mm + dx * n, p.y_mm + dy * n, cx, cy))
+        adjust(cx, cy, GRID_HIT);
+}
+
+// a sonar bearing is clockwise in degrees, the heading counterclockwise
+static float sensor_angle(const pose &p, uint8_t sensor)
+{
+    return p.heading - robot.sensors[sensor].bearing_deg * ((float)M_PI / 180.0f);
+}
+
+void grid_update(const pose &p, uint8_t updated, const range_reading * ranges)
+{
+    if (clear_requested.exchange(false))
+    {
+        memset(cells, GRID_PRIOR | (GRID_PRIOR << 4), sizeof(cells));
+        mark_all_dirty();
+    }
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        if (!(updated & (1 << i)) || ranges[i].confidence < RANGE_MIN_CONFIDENCE)
+            continue;
+        // far echoes are too wide to place, they only clear the way
+        bool hit = ranges[i].mm < GRID_MAX_RANGE_MM;
+        cast(p, sensor_angle(p, i), hit ? ranges[i].mm : GRID_MAX_RANGE_MM, hit);
+    }
+}
+
+uint8_t grid_cell(float x_mm, float y_mm)
+{
+    int32_t cx, cy;
+    return to_cell(x_mm, y_mm, cx, cy) ? get(cx, cy) : GRID_PRIOR;
+}
+
+bool grid_occupied(float x_mm, float y_mm)
+{
+    return grid_cell(x_mm, y_mm) >= GRID_OCCUPIED;
+}
+
+uint16_t grid_clearance(const pose &p, float angle, uint16_t max_mm)
+{
+    float dx = cosf(angle) * step_mm;
+    float dy = sinf(angle) * step_mm;
+    int32_t n = max_mm / step_mm;
+
+    for (int32_t k = 1; k <= n; k++)
+    {
+        int32_t cx, cy;
+        if (!to_cell(p.x_mm + dx * k, p.y_mm + dy * k, cx, cy))
+            break;
+        if (get(cx, cy) >= GRID_OCCUPIED)
+            return k * step_mm;
+    }
+    return max_mm;
+}
+
+void grid_limit(const pose &p, range_reading * ranges)
+{
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        uint16_t mm = grid_clearance(p, sensor_angle(p, i), PLAN_CLEAR_MM);
+        if (mm == PLAN_CLEAR_MM)
+            continue;
+        // a weak reading gives way to the map, a steady one only to a
+        // nearer obstacle
+        if (ranges[i].confidence < RANGE_MIN_CONFIDENCE || mm < ranges[i].mm)
+            ranges[i] = {mm, RANGE_MIN_CONFIDENCE};
+    }
+}
+
+static void send_tile(uint16_t tile)
+{
+    uint8_t msg[1 + 1 + GRID_TILE_BYTES] = {OP_GRID_TILE, (uint8_t)tile};
+    uint8_t * p = &msg[2];
+    int32_t x0 = (tile % (GRID_CELLS / GRID_TILE)) * GRID_TILE;
+    int32_t y0 = (tile / (GRID_CELLS / GRID_TILE)) * GRID_TILE;
+
+    // row by row, the even cell of a pair in the low nibble
+    for (int32_t y = y0; y < y0 + GRID_TILE; y++)
+        for (int32_t x = x0; x < x0 + GRID_TILE; x += 2)
+            *p++ = get(x, y) | (get(x + 1, y) << 4);
+    link_send(msg, sizeof(msg));
+}
+
+void grid_sync(uint8_t flags)
+{
+    if (flags & GRID_SYNC_CLEAR)
+        clear_requested = true;
+    if (flags & GRID_SYNC_FULL)
+        mark_all_dirty();
+
+    // a tile's bit is cleared before it is read, so a change racing the
+    // copy dirties it again and goes out with the next sync
+    uint8_t sent = 0;
+    for (uint16_t k = 0; k < GRID_TILES && sent < GRID_SYNC_TILES; k++)
+    {
+        uint16_t tile = (next_tile + k) % GRID_TILES;
+        uint32_t bit = 1u << (tile % 32);
+        if (!(dirty[tile / 32].fetch_and(~bit) & bit))
+            continue;
+        send_tile(tile);
+        sent++;
+        next_tile = (tile + 1) % GRID_TILES;
+    }
+
+    uint16_t left = 0;
+    for (std::atomic<uint32_t> &d : dirty)
+        left += __builtin_popcount(d.load());
+
+    uint8_t status[1 + 6] = {OP_GRID_STATUS};
+    uint8_t * p = proto_put_u16(&status[1], left);
+    p = proto_put_u16(p, GRID_CELLS);
+    proto_put_u16(p, GRID_CELL_MM);
+    link_send(status, sizeof(status));
+}
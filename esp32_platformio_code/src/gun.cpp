@@ -0,0 +1,82 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "config.h"
+#include "gpio_fast.h"
+#include "gun.h"
+#include "recorder.h"
+
+static esp_timer_handle_t timer;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile gun_state state = GUN_IDLE;
+static uint8_t shots_left = 0;
+
+static void pull()
+{
+    gpio_fast_level(robot.gun, LOW);
+    state = GUN_PULL;
+    esp_timer_start_once(timer, robot.fire_pulse_ms * 1000ULL);
+    rec_log(REC_FIRE, shots_left, 0, 0, 0);
+}
+
+static void gun_timer(void * arg)
+{
+    portENTER_CRITICAL(&lock);
+    switch (state) {
+        case GUN_PULL:
+            gpio_fast_level(robot.gun, HIGH);
+            state = GUN_COOLDOWN;
+            esp_timer_start_once(timer, robot.fire_rate_ms * 1000ULL);
+            break;
+        case GUN_COOLDOWN:
+            if (shots_left && --shots_left)
+                pull();
+            else
+                state = GUN_IDLE;
+            break;
+        default:
+            break;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void gun_init()
+{
+    pinMode(robot.gun, OUTPUT);
+    gpio_fast_level(robot.gun, HIGH);
+
+    esp_timer_create_args_t args = {};
+    args.callback = gun_timer;
+    args.name = "gun";
+    esp_timer_create(&args, &timer);
+}
+
+bool gun_fire(uint8_t shots)
+{
+    bool started = false;
+
+    portENTER_CRITICAL(&lock);
+    if (state == GUN_IDLE && shots)
+    {
+        shots_left = shots;
+        pull();
+        started = true;
+    }
+    portEXIT_CRITICAL(&lock);
+    return started;
+}
+
+void gun_safe()
+{
+    portENTER_CRITICAL(&lock);
+    esp_timer_stop(timer);
+    gpio_fast_level(robot.gun, HIGH);
+    shots_left = 0;
+    state = GUN_IDLE;
+    portEXIT_CRITICAL(&lock);
+}
+
+gun_state gun_get_state()
+{
+    return state;
+}
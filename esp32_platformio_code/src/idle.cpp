@@ -0,0 +1,110 @@
+#include <Arduino.h>
+#include <driver/uart.h>
+#include <esp_sleep.h>
+#include <esp_task_wdt.h>
+#include <freertos/semphr.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "control.h"
+#include "idle.h"
+#include "recorder.h"
+#include "stepper.h"
+
+static volatile bool idle = false;
+static std::atomic<bool> woken{false};  // idle_wake -> control loop
+static SemaphoreHandle_t resume;        // cuts a sweep gap short
+
+// only the control loop touches this
+static uint32_t rest_ticks = 0;
+
+// only the sensor task touches this
+static uint32_t gap_ms = 0;
+
+void idle_init()
+{
+    resume = xSemaphoreCreateBinary();
+#if IDLE_LIGHT_SLEEP
+    uart_set_wakeup_threshold(LINK_UART, IDLE_WAKE_EDGES);
+    esp_sleep_enable_uart_wakeup(LINK_UART);
+#endif
+}
+
+static void leave()
+{
+    if (!idle)
+        return;
+    idle = false;
+    xSemaphoreGive(resume);
+    rec_log(REC_IDLE, 0, 0, 0, 0);
+}
+
+void idle_run(bool busy)
+{
+    bool rest = !busy;
+    for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+        if (stepper_rate(i) || stepper_output_rate(i))
+            rest = false;
+
+    if (woken.exchange(false) || !rest)
+    {
+        rest_ticks = 0;
+        leave();
+        return;
+    }
+    if (idle || ++rest_ticks < IDLE_AFTER_MS * CONTROL_RATE_HZ / 1000)
+        return;
+
+    // the pulse trains are long off, the drivers go too
+    stepper_stop();
+    idle = true;
+    rec_log(REC_IDLE, 1, 0, 0, 0);
+}
+
+void idle_wake()
+{
+    woken = true;
+    leave();
+}
+
+bool idle_active()
+{
+    return idle;
+}
+
+void idle_pause(bool moved)
+{
+    if (!idle)
+    {
+        gap_ms = 0;
+        return;
+    }
+
+    // the gap stretches while nothing in range moves
+    if (moved || !gap_ms)
+        gap_ms = IDLE_SCAN_MIN_MS;
+    else if (gap_ms < IDLE_SCAN_MAX_MS)
+        gap_ms = gap_ms * 2 < IDLE_SCAN_MAX_MS ? gap_ms * 2 : IDLE_SCAN_MAX_MS;
+
+    uint32_t start = millis();
+    while (idle)
+    {
+        uint32_t spent = millis() - start;
+        if (spent >= gap_ms)
+            break;
+#if IDLE_LIGHT_SLEEP
+        // every task stops with the clocks, the control timer included
+        esp_sleep_enable_timer_wakeup((gap_ms - spent) * 1000ULL);
+        esp_light_sleep_start();
+        control_resync();
+
+        // the wake edges are the head of a frame, stay up for the rest
+        if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UART)
+            xSemaphoreTake(resume, pdMS_TO_TICKS(IDLE_WAKE_HOLD_MS));
+#else
+        xSemaphoreTake(resume, pdMS_TO_TICKS(gap_ms - spent));
+#endif
+        esp_task_wdt_reset();
+    }
+}
@@ -0,0 +1,300 @@
+#include <Arduino.h>
+#include <driver/uart.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
+#include <freertos/ringbuf.h>
+#include <freertos/semphr.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "link.h"
+#include "profiler.h"
+
+static QueueHandle_t uart_events;
+static QueueHandle_t frames;
+static QueueSetHandle_t frame_set;  // frames and every other transport's queue
+static link_send_fn senders[LINK_TRANSPORTS];
+static uint8_t transports = 1;
+static volatile uint8_t reply_transport = LINK_SERIAL;
+static TaskHandle_t rx_task;
+static TaskHandle_t tx_task;
+static RingbufHandle_t tx_ring;
+static SemaphoreHandle_t uart_tx_lock;  // the TX task's chunks vs. baud acks and switches
+static proto_parser parser;
+static link_stats stats;
+static std::atomic<uint32_t> tx_seq{0};
+
+// Baud negotiation: the host proposes a rate with OP_BAUD, we acknowledge at
+// the old rate and switch. The new rate is kept once a valid frame arrives
+// within LINK_BAUD_CONFIRM_MS, otherwise we go back to the last confirmed
+// one. A link that stays silent for LINK_BAUD_IDLE_MS drops to LINK_BAUD so
+// a restarted host always finds us at the boot rate.
+static uint32_t baud;
+static uint32_t confirmed_baud;
+static int64_t confirm_deadline_us;
+static int64_t last_frame_us;
+static volatile uint32_t heard_us;  // low half of last_frame_us, read from other cores
+
+// link_set_baud runs with uart_tx_lock held
+static void link_set_baud(uint32_t rate)
+{
+    uart_wait_tx_done(LINK_UART, pdMS_TO_TICKS(50));
+    uart_set_baudrate(LINK_UART, rate);
+    uart_flush_input(LINK_UART);
+    proto_parser_reset(parser);
+    baud = rate;
+}
+
+static size_t link_frame_out(uint8_t * frame, const uint8_t * payload, uint8_t len)
+{
+    return proto_encode(frame, tx_seq.fetch_add(1), payload, len);
+}
+
+static void link_propose_baud(uint32_t rate)
+{
+    uint8_t reply[1 + 4] = {OP_BAUD_ACK};
+    uint8_t frame[PROTO_MAX_FRAME];
+
+    if (rate < LINK_BAUD_MIN || rate > LINK_BAUD_MAX)
+        rate = 0;
+    proto_put_u32(&reply[1], rate);
+
+    // the ack has to leave at the old rate, so it skips the TX queue. The
+    // lock keeps it from landing inside a chunk the TX task is writing, and
+    // nothing else goes out until the new rate is set.
+    xSemaphoreTake(uart_tx_lock, portMAX_DELAY);
+    uart_write_bytes(LINK_UART, frame, link_frame_out(frame, reply, sizeof(reply)));
+    if (rate != 0 && rate != baud)
+    {
+        link_set_baud(rate);
+        confirm_deadline_us = esp_timer_get_time() + LINK_BAUD_CONFIRM_MS * 1000LL;
+    }
+    xSemaphoreGive(uart_tx_lock);
+}
+
+static void link_check_baud()
+{
+    int64_t now = esp_timer_get_time();
+
+    if (confirm_deadline_us && now > confirm_deadline_us)
+    {
+        stats.baud_fallbacks++;
+        confirm_deadline_us = 0;
+        xSemaphoreTake(uart_tx_lock, portMAX_DELAY);
+        link_set_baud(confirmed_baud);
+        xSemaphoreGive(uart_tx_lock);
+    } else if (baud != LINK_BAUD && now - last_frame_us > LINK_BAUD_IDLE_MS * 1000LL)
+    {
+        stats.baud_fallbacks++;
+        confirmed_baud = LINK_BAUD;
+        xSemaphoreTake(uart_tx_lock, portMAX_DELAY);
+        link_set_baud(LINK_BAUD);
+        xSemaphoreGive(uart_tx_lock);
+    }
+}
+
+static void link_frame(const proto_frame &frame)
+{
+    last_frame_us = esp_timer_get_time();
+    heard_us = (uint32_t)last_frame_us;
+    if (confirm_deadline_us)
+    {
+        confirm_deadline_us = 0;
+        confirmed_baud = baud;
+    }
+
+    if (frame.payload[0] == OP_BAUD && frame.len == 1 + 4)
+    {
+        link_propose_baud(proto_get_u32(&frame.payload[1]));
+        return;
+    }
+
+    link_rx rx;
+    rx.frame = frame;
+    rx.rx_us = last_frame_us;
+    rx.transport = LINK_SERIAL;
+    if (xQueueSend(frames, &rx, 0) == pdTRUE)
+        stats.frames++;
+    else
+        stats.dropped++;
+}
+
+static void link_rx_task(void * parameter)
+{
+    uart_event_t event;
+    uint8_t buf[LINK_RX_CHUNK];
+
+    while (1)
+    {
+        // only a negotiated rate needs the periodic fallback check
+        TickType_t wait = baud == LINK_BAUD && !confirm_deadline_us ? portMAX_DELAY : pdMS_TO_TICKS(50);
+
+        if (xQueueReceive(uart_events, &event, wait) != pdTRUE)
+        {
+            link_check_baud();
+            continue;
+        }
+
+        switch (event.type) {
+            case UART_DATA:
+            {
+                PROFILE(PROF_LINK_RX);
+                int n;
+                while ((n = uart_read_bytes(LINK_UART, buf, sizeof(buf), 0)) > 0)
+                {
+                    for (int i = 0; i < n; i++)
+                    {
+                        if (proto_feed(parser, buf[i]))
+                            link_frame(parser.frame);
+                    }
+                }
+                break;
+            }
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                // the stream is broken, start over at the next sync byte
+                stats.overflows++;
+                uart_flush_input(LINK_UART);
+                xQueueReset(uart_events);
+                proto_parser_reset(parser);
+                break;
+            default:
+                break;
+        }
+        link_check_baud();
+    }
+}
+
+// link_tx_task is the only writer of the UART TX path apart from baud acks,
+// which it shares uart_tx_lock with. Producers drop frames into tx_ring
+// without ever waiting; if the UART falls behind it is this task that
+// blocks, not the motor or sensor loop.
+static void link_tx_task(void * parameter)
+{
+    while (1)
+    {
+        size_t n;
+        void * data = xRingbufferReceiveUpTo(tx_ring, &n, portMAX_DELAY, LINK_TX_CHUNK);
+        if (!data)
+            continue;
+        xSemaphoreTake(uart_tx_lock, portMAX_DELAY);
+        uart_write_bytes(LINK_UART, data, n);
+        xSemaphoreGive(uart_tx_lock);
+        vRingbufferReturnItem(tx_ring, data);
+    }
+}
+
+void link_init(uint32_t rate)
+{
+    uart_config_t cfg = {};
+    cfg.baud_rate = rate;
+    cfg.data_bits = UART_DATA_8_BITS;
+    cfg.parity = UART_PARITY_DISABLE;
+    cfg.stop_bits = UART_STOP_BITS_1;
+    cfg.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    cfg.source_clk = UART_SCLK_APB;
+
+    uart_driver_install(LINK_UART, LINK_RX_BUFFER, LINK_TX_BUFFER, LINK_EVENT_QUEUE, &uart_events, 0);
+    uart_param_config(LINK_UART, &cfg);
+    uart_set_pin(LINK_UART, LINK_TX_PIN, LINK_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+
+    // raise a data event after a short idle gap or a partly filled FIFO,
+    // not only when the 120 byte default threshold is reached
+    uart_set_rx_timeout(LINK_UART, LINK_RX_TIMEOUT_SYMBOLS);
+    uart_set_rx_full_threshold(LINK_UART, LINK_RX_FULL_THRESHOLD);
+
+    proto_parser_reset(parser);
+    baud = confirmed_baud = rate;
+    frames = xQueueCreate(LINK_FRAME_QUEUE, sizeof(link_rx));
+    frame_set = xQueueCreateSet(LINK_FRAME_QUEUE * LINK_TRANSPORTS);
+    xQueueAddToSet(frames, frame_set);
+    tx_ring = xRingbufferCreate(LINK_TX_QUEUE, RINGBUF_TYPE_BYTEBUF);
+    uart_tx_lock = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(link_rx_task, "LinkRx", LINK_RX_STACK, NULL, LINK_RX_PRIORITY, &rx_task, 0);
+    xTaskCreatePinnedToCore(link_tx_task, "LinkTx", LINK_TX_STACK, NULL, LINK_TX_PRIORITY, &tx_task, 0);
+}
+
+uint8_t link_add_transport(QueueHandle_t queue, link_send_fn send)
+{
+    if (transports == LINK_TRANSPORTS || xQueueAddToSet(queue, frame_set) != pdPASS)
+        return 0;
+    senders[transports] = send;
+    return transports++;
+}
+
+bool link_receive(link_rx &rx, TickType_t wait)
+{
+    QueueSetMemberHandle_t queue = xQueueSelectFromSet(frame_set, wait);
+    if (!queue || xQueueReceive(queue, &rx, 0) != pdTRUE)
+        return false;
+
+    // the UART frames were counted as heard when parsed, the dead-man stop
+    // covers the other transports from here
+    if (rx.transport != LINK_SERIAL)
+        heard_us = (uint32_t)rx.rx_us;
+    reply_transport = rx.transport;
+    return true;
+}
+
+void link_applied(const link_rx &rx)
+{
+    uint32_t latency = esp_timer_get_time() - rx.rx_us;
+
+    stats.latency_us = latency;
+    if (latency > stats.latency_max_us)
+        stats.latency_max_us = latency;
+}
+
+static bool link_queue(const void * data, size_t n, TickType_t wait = 0)
+{
+    if (xRingbufferSend(tx_ring, data, n, wait) == pdTRUE)
+        return true;
+    stats.tx_dropped++;
+    return false;
+}
+
+bool link_send(const uint8_t * payload, uint8_t len)
+{
+    return link_send_wait(payload, len, 0);
+}
+
+bool link_send_wait(const uint8_t * payload, uint8_t len, TickType_t wait)
+{
+    uint8_t frame[PROTO_MAX_FRAME];
+    size_t n = link_frame_out(frame, payload, len);
+    uint8_t transport = reply_transport;
+    if (transport != LINK_SERIAL)
+        return senders[transport](frame, n);
+    return link_queue(frame, n, wait);
+}
+
+void link_print(const char * text)
+{
+    link_queue(text, strlen(text));
+}
+
+uint32_t link_last_frame_us()
+{
+    return heard_us;
+}
+
+TaskHandle_t link_rx_handle()
+{
+    return rx_task;
+}
+
+TaskHandle_t link_tx_handle()
+{
+    return tx_task;
+}
+
+uint32_t link_baud()
+{
+    return baud;
+}
+
+const link_stats &link_get_stats()
+{
+    return stats;
+}
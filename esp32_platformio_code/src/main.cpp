@@ -1,191 +1,137 @@
 #include <Arduino.h>
-
-// MOTOR CONFIG
-// Motor 1 pins
-#define EN 23
-#define DIR 4
-#define PUL 5
-
-// Motor 2 pins
-#define EN2 27
-#define DIR2 26
-#define PUL2 25
-
-// GUN CONFIG
-#define GUN 33
-#define FIRE_RATE_MS 1000
-
-// ROBOT CONFIG
-#define SPEED 750
-#define SPEED_REDUCTION 1
-
-// SENSOR CONFIG
-#define TRIG_PIN {17, 18, 19, 21, 22}
-#define ECHO_PIN {16, 34, 35, 36, 39}
-#define WALL_LIMIT 4000
-
-char motion = 'f';
-char old_motion = 'a';
-char roam_en = '0';
+#include <esp_task_wdt.h>
+
+#include "config.h"
+#include "control.h"
+#include "dispatch.h"
+#include "drive.h"
+#include "grid.h"
+#include "gun.h"
+#include "idle.h"
+#include "link.h"
+#include "odometry.h"
+#include "planner.h"
+#include "profiler.h"
+#include "protocol.h"
+#include "radio.h"
+#include "range_filter.h"
+#include "recorder.h"
+#include "segments.h"
+#include "shared_state.h"
+#include "stepper.h"
+#include "telemetry.h"
+#include "track.h"
+#include "ultrasonic.h"
+
+// only the control loop touches these, the sensor side arrives through
+// sensor_state
+uint32_t roam_version = 0;     // sensor_state version last roamed on
+uint32_t roam_t_us = 0;
+uint32_t timeout_heard_us = 0;  // last frame time a dead-man stop was made for
+volatile uint32_t timeouts = 0; // dead-man stops so far, the comms task follows
+
+// only the comms task touches this, how many dead-man stops it has seen
+uint32_t seen_timeouts = 0;
+
+seqlock<sensor_frame> sensor_state;
 
 
 // Task Handles
 TaskHandle_t Task1;
 TaskHandle_t Task2;
 
-//////////////////////////////////////////////////////////////////////
-////////////////////// ULTRASONIC ////////////////////////////////////
-//////////////////////////////////////////////////////////////////////
-volatile unsigned long echo_init[] = {0,0,0,0,0};
-volatile unsigned long echo_time[] = {0,0,0,0,0};
-
-// ultra_trig fires all of the ultrasonic sensors
-void ultra_trig()
-{
-    char pins[] = TRIG_PIN;
-    for (char i = 0; i < 5; i++)
-    {
-        digitalWrite(pins[i], HIGH);
-        delayMicroseconds(10);
-        digitalWrite(pins[i], LOW);
-    }
-}
-
-// echo_handler calculates the time difference when the echo
-// is recieved
-void echo_handler(char index)
+// roam drives along a planner command, both wheels ramp to the mixed rates
+void roam(const planner_output &plan)
 {
-    char pins[] = ECHO_PIN;
-    switch (digitalRead(pins[index]))
-    {
-      case HIGH:
-          echo_init[index] = micros();
-          break;
-      case LOW:
-          echo_time[index] = micros() - echo_init[index];
-          //is_echos[index] = 1;
-          break;
-    }
+    int32_t rate1, rate2;
+    drive_mix(plan.forward, plan.turn, STEPPER_MAX_RATE, rate1, rate2);
+    stepper_set_rates(rate1, rate2);
 }
 
-void pindex0ISR() {echo_handler(0);}
-
-void pindex1ISR() {echo_handler(1);}
-
-void pindex2ISR() {echo_handler(2);}
-
-void pindex3ISR() {echo_handler(3);}
-
-void pindex4ISR() {echo_handler(4);}
-
-char init_ultrasonic()
+void Task2ReadSensor(void * parameter)
 {
-    char e_pins[] = ECHO_PIN;
-    char t_pins[] = TRIG_PIN;
-
-    for (char e_pin : e_pins)
-    {
-        pinMode(e_pin, INPUT);
-    }
+    range_filter filters[SENSOR_COUNT];
+    sensor_frame frame = {};
+    range_filter_config cfg = {RANGE_MEDIAN, RANGE_EMA_ALPHA, RANGE_OUTLIER_MM,
+                               RANGE_OUTLIER_CONFIRM, RANGE_FAR_MM};
+    planner_state plan;
+    planner_config plan_cfg = {{}, PLAN_STOP_MM, PLAN_SLOW_MM, PLAN_CLEAR_MM,
+                               PLAN_FRONT_DEG, PLAN_BEARING_COST, RANGE_MIN_CONFIDENCE,
+                               PLAN_MAX_FORWARD, PLAN_MAX_TURN, PLAN_TURN_GAIN};
 
-    attachInterrupt(e_pins[0], pindex0ISR, CHANGE);
-    attachInterrupt(e_pins[1], pindex1ISR, CHANGE);
-    attachInterrupt(e_pins[2], pindex2ISR, CHANGE);
-    attachInterrupt(e_pins[3], pindex3ISR, CHANGE);
-    attachInterrupt(e_pins[4], pindex4ISR, CHANGE);
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+        plan_cfg.bearing_deg[i] = robot.sensors[i].bearing_deg;
 
-    for (char t_pin : t_pins)
-    {
-        pinMode(t_pin, OUTPUT);
-        digitalWrite(t_pin, LOW);
-    }
+    for (range_filter &f : filters)
+        range_filter_init(f, cfg);
+    planner_init(plan);
 
-    return 0;
-}
-
-void roam(char motion)
-{
+    // ranges at the end of the last full sweep, for idle_pause
+    uint16_t swept_mm[SENSOR_COUNT] = {};
+    uint8_t swept = 0;
 
-    tone(PUL, SPEED/SPEED_REDUCTION);
-    tone(PUL2, SPEED/SPEED_REDUCTION);
-    digitalWrite(EN, LOW);
-    digitalWrite(EN2, LOW);
-
-    switch (motion) {
-        case 'f':
-            // Forward motion logic
-            //Serial.println("Moving Forward");
-            //tone(PUL, SPEED/SPEED_REDUCTION);
-            //tone(PUL2, SPEED/SPEED_REDUCTION);
-            //digitalWrite(EN, LOW);
-            digitalWrite(DIR, HIGH);
-            //digitalWrite(EN2, LOW);
-            digitalWrite(DIR2, LOW);
-            //firelock = 0;
-            break;
-        case 'l':
-            // Right turn logic
-            //tone(PUL, SPEED/SPEED_REDUCTION);
-            //tone(PUL2, SPEED/SPEED_REDUCTION);
-            //digitalWrite(EN, LOW);
-            digitalWrite(DIR, HIGH);
-            //digitalWrite(EN2, LOW);
-            digitalWrite(DIR2, HIGH);
-            //firelock = 0;
-            break;
-        case 'r':
-            // Left turn logic
-            //tone(PUL, SPEED/SPEED_REDUCTION);
-            //tone(PUL2, SPEED/SPEED_REDUCTION);
-            //digitalWrite(EN, LOW);
-            digitalWrite(DIR, LOW);
-            //digitalWrite(EN2, LOW);
-            digitalWrite(DIR2, LOW);
-            //firelock = 0;
-            break;
-        default:
-            // Optional: handle unknown motion
-            Serial.println("Unknown motion");
-            break;
-    }
-}
+    // last good pose, kept when a read collides with the odometry timer
+    pose here = {};
 
-void Task2ReadSensor(void * parameter)
-{
-    //char motion = 'f';
     init_ultrasonic();
+    esp_task_wdt_add(NULL);
 
     while (1)
     {
-        int a = echo_time[0];
-        int b = echo_time[1];
-        int c = echo_time[2];
-        int d = echo_time[3];
-        int e = echo_time[4];
-
-        int center = c;
-        int left = a + b / 2;
-        int right = d + e / 2;
+        // fires the next slot and returns once its echoes are in
+        uint32_t start = micros();
+        uint8_t updated = ultrasonic_scan();
 
-        if (center < WALL_LIMIT)
         {
-            if (left < right)
+            PROFILE(PROF_RANGE_FILTER);
+            for (uint8_t i = 0; i < SENSOR_COUNT; i++)
             {
-                motion = 'r';
-            } else
-            {
-                motion = 'r';
+                if (!(updated & (1 << i)))
+                    continue;
+                echo_sample s = ultrasonic_sample(i);
+                frame.ranges[i] = range_filter_update(filters[i], cfg, s.status, s.echo_us);
+                rec_log(REC_SENSOR, i, frame.ranges[i].mm, s.echo_us,
+                        s.status | (frame.ranges[i].confidence << 8));
             }
-        } else
+        }
+
+        // the new ranges go into the map, and the planner also steers
+        // clear of the obstacles the map knows on its bearings
+        range_reading ranges[SENSOR_COUNT];
         {
-            motion = 'f';
+            PROFILE(PROF_GRID);
+            odometry_get(here);
+            grid_update(here, updated, frame.ranges);
+            memcpy(ranges, frame.ranges, sizeof(ranges));
+            grid_limit(here, ranges);
         }
 
-//        Serial.println(a);
+        // the planner runs here at the sensor rate, the control loop only
+        // mixes and applies what it decides
+        {
+            PROFILE(PROF_PLANNER);
+            frame.plan = planner_update(plan, plan_cfg, ranges);
+        }
 
-        ultra_trig();
+        frame.t_us = micros();
+        sensor_state.write(frame);
+        telemetry_loop_time(TELEMETRY_SCAN, frame.t_us - start);
+        esp_task_wdt_reset();
 
-        vTaskDelay(10 / portTICK_PERIOD_MS); //gives the task some delay
+        // in idle the task rests between full sweeps
+        swept |= updated;
+        if (swept == (1 << SENSOR_COUNT) - 1)
+        {
+            bool moved = false;
+            for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                if (abs((int32_t)frame.ranges[i].mm - swept_mm[i]) > IDLE_MOTION_MM)
+                    moved = true;
+                swept_mm[i] = frame.ranges[i].mm;
+            }
+            swept = 0;
+            idle_pause(moved);
+        }
     }
 }
 
@@ -194,149 +140,124 @@ void Task2ReadSensor(void * parameter)
 //////////////////////////////////////////////////////////////////////
 
 
-void Task1MotorController(void * parameter)
+// control_loop runs once per control tick: it advances the segment queue,
+// the bearing tracker and the ramps, watches the link, counts down to idle
+// and, while roaming, applies every new planner command from the sensor core
+void control_loop()
 {
-    pinMode(EN, OUTPUT);
-    pinMode(DIR, OUTPUT);
-    pinMode(PUL, OUTPUT);
-
-    pinMode(EN2, OUTPUT);
-    pinMode(DIR2, OUTPUT);
-    pinMode(PUL2, OUTPUT);
+    PROFILE(PROF_CONTROL);
+    segments_run();
+    track_run();
+    stepper_tick();
+
+    // dead-man stop, once per silence: any valid frame counts as a
+    // heartbeat, the next motion command starts the robot again. An idle
+    // robot is only beaten once a second and gets a wider window.
+    uint32_t heard = link_last_frame_us();
+    uint32_t window_ms = idle_active() ? IDLE_LINK_TIMEOUT_MS : LINK_TIMEOUT_MS;
+    if (heard && heard != timeout_heard_us && micros() - heard > window_ms * 1000)
+    {
+        timeout_heard_us = heard;
+        timeouts++;
+        roam_en = '0';
+        segments_clear();
+        track_stop();
+        stepper_stop();
+        gun_safe();
+        telemetry_set_mode(TELEMETRY_MODE_TIMEOUT);
+    }
 
-    pinMode(GUN, OUTPUT);
-    digitalWrite(GUN, HIGH);
+    idle_run(roam_en == '1' || gun_get_state() != GUN_IDLE);
 
-    int firelock = 0;
-    char lastChar = '\0';
+    if (roam_en != '1')
+    {
+        roam_version = 0;
+        return;
+    }
 
-    while (1)
+    // a sensor task that stops publishing stops the robot
+    sensor_frame frame;
+    uint32_t version = sensor_state.version();
+    if (version != roam_version && sensor_state.try_read(frame))
     {
+        roam_version = version;
+        roam_t_us = frame.t_us;
+        roam(frame.plan);
+    } else if (roam_version && micros() - roam_t_us > SENSOR_STALE_US)
+    {
+        roam_version = 0;
+        stepper_stop();
+    }
+}
+
+void Task1Comms(void * parameter)
+{
+    link_rx batch[LINK_FRAME_QUEUE];
 
-//        Serial.println(motion);
+    esp_task_wdt_add(NULL);
 
-        if (Serial.available())
+    while (1)
+    {
+        // wakes as soon as a transport hands over a frame, the timeout only
+        // keeps the task watchdog fed while the host is quiet. Whatever
+        // queued up behind it is taken in the same batch.
+        uint8_t count = 0;
+        if (link_receive(batch[0], 100 / portTICK_PERIOD_MS))
         {
-            char input = Serial.read(); // Read serial input
-            Serial.flush();
-            // go backwards
-            if (input == 'w' && input != lastChar)
-            {
-                roam_en = '0';
-                tone(PUL, SPEED);
-                tone(PUL2, SPEED);
-                digitalWrite(EN, LOW);
-                digitalWrite(DIR, HIGH);
-                digitalWrite(EN2, LOW);
-                digitalWrite(DIR2, LOW);
-                firelock = 0;
-                lastChar = input;
-            }
-            // turn left
-            else if (input == 'd' && input != lastChar)
-            {
-                roam_en = '0';
-                tone(PUL, SPEED/SPEED_REDUCTION);
-                tone(PUL2, SPEED/SPEED_REDUCTION);
-                digitalWrite(EN, LOW);
-                digitalWrite(DIR, HIGH);
-                digitalWrite(EN2, LOW);
-                digitalWrite(DIR2, HIGH);
-                firelock = 0;
-                lastChar = input;
-            }
-            // turn right
-            else if (input == 'a' && input != lastChar)
-            {
-                roam_en = '0';
-                tone(PUL, SPEED/SPEED_REDUCTION);
-                tone(PUL2, SPEED/SPEED_REDUCTION);
-                digitalWrite(EN, LOW);
-                digitalWrite(DIR, LOW);
-                digitalWrite(EN2, LOW);
-                digitalWrite(DIR2, LOW);
-                firelock = 0;
-                lastChar = input;
-            }
-            // go forwards
-            else if (input == 's' && input != lastChar)
-            {
-                roam_en = '0';
-                tone(PUL, SPEED);
-                tone(PUL2, SPEED);
-                digitalWrite(EN, LOW);
-                digitalWrite(DIR, LOW);
-                digitalWrite(EN2, LOW);
-                digitalWrite(DIR2, HIGH);
-                firelock = 0;
-                lastChar = input;
-            }
-            // firing the gun
-            else if (input == 'f' && firelock == 0 && input != lastChar)
-            {
-                roam_en = '0';
-                firelock = 1;
-                digitalWrite(EN, HIGH);
-                digitalWrite(EN2, HIGH);
-                digitalWrite(GUN, LOW);
-                vTaskDelay( FIRE_RATE_MS / portTICK_PERIOD_MS);
-                digitalWrite(GUN, HIGH);
-                lastChar = input;
-            }
-            // roam
-            else if (input == 'r' && input != lastChar)
-            {
-                roam_en = '1';
-                //roam(motion);
-                firelock = 0;
-                lastChar = input;
-            }
-            // stop
-            else if (input == 'q' && input != lastChar)
-            {
-                roam_en = '0';
-                digitalWrite(EN, HIGH);
-                digitalWrite(EN2, HIGH);
-                firelock = 0;
-                lastChar = input;
-            }
-            // stop
-            else if (input != lastChar)
-            {
-                roam_en = '0';
-                digitalWrite(EN, HIGH);
-                digitalWrite(EN2, HIGH);
-                lastChar = input;
-            }
+            count = 1;
+            while (count < LINK_FRAME_QUEUE && link_receive(batch[count], 0))
+                count++;
         }
 
-        if (roam_en == '1' && (old_motion != motion))
+        // after a dead-man stop the same state has to be applied again
+        if (seen_timeouts != timeouts)
         {
-            old_motion = motion;
-            Serial.print(old_motion);
-            Serial.print(" ");
-            Serial.print(motion);
-            Serial.println(" motion changed");
-            roam(motion);
-            //lastChar = input;
+            seen_timeouts = timeouts;
+            dispatch_forget_state();
         }
 
-        vTaskDelay(100 / portTICK_PERIOD_MS); //gives the task some delay
-        Serial.flush();
+        if (count)
+            handle_batch(batch, count);
+        esp_task_wdt_reset();
     }
+}
 
+// robot_start brings up the link, the drivers and every task
+void robot_start()
+{
+    link_init(LINK_BAUD);
+    radio_init();
+    link_print("<Arduino is ready>\n");
+
+    stepper_init();
+    odometry_init();
+    gun_init();
+    idle_init();
+    rec_init();
+
+    // a task that stops checking in resets the board instead of leaving the
+    // wheels on their last rates
+    esp_task_wdt_init(TASK_WDT_TIMEOUT_S, true);
+
+    // Comms pin to core 0 next to the link, frames are copied onto its stack
+    xTaskCreatePinnedToCore(Task1Comms, "Task1Comms", COMMS_STACK, NULL, COMMS_PRIORITY, &Task1, 0);
+    // Read Sensor pin to core 1, it keeps the filter and planner state on its stack
+    xTaskCreatePinnedToCore(Task2ReadSensor, "Task2ReadSensor", SENSOR_STACK, NULL, SENSOR_PRIORITY, &Task2, 1);
+    control_start(control_loop);
+
+    telemetry_init(Task1, Task2);
 }
 
+// the on-device test suites call robot_start from their own setup
+#ifndef PIO_UNIT_TESTING
 void setup()
 {
-
-    Serial.begin(9600);
-    Serial.println("<Arduino is ready>");
-
-    // Motor Controller with stack 1000 pin to core 0
-    xTaskCreatePinnedToCore(Task1MotorController, "Task1MotorController", 1000, NULL, 1, &Task1, 0);
-    // Read Sensor with stack 1000 pin to core 1
-    xTaskCreatePinnedToCore(Task2ReadSensor, "Task2ReadSensor", 1000, NULL, 1, &Task2, 1);
+    robot_start();
 }
 
-void loop() {}
+// everything runs in the tasks above, the Arduino loop task is not needed
+void loop()
+{
+    vTaskDelete(NULL);
+}
+#endif
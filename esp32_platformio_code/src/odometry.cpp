@@ -0,0 +1,93 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <math.h>
+
+#include "config.h"
+#include "link.h"
+#include "odometry.h"
+#include "protocol.h"
+#include "seqlock.h"
+#include "stepper.h"
+
+static constexpr float mm_per_step = robot.mm_per_rev / robot.steps_per_rev;
+
+static esp_timer_handle_t timer;
+static seqlock<pose> published;
+static seqlock<pose> requested;     // odometry_set, consumed by the timer
+
+static pose state;
+static int32_t last_steps[STEPPER_COUNT];
+static uint32_t applied = 0;        // version of requested last applied
+static uint16_t report_div = 0;
+
+static void odometry_tick(void * arg)
+{
+    pose req;
+    if (requested.version() != applied && requested.try_read(req))
+    {
+        applied = requested.version();
+        state = req;
+    }
+
+    int32_t d[STEPPER_COUNT];
+    for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+    {
+        int32_t steps = stepper_steps(i);
+        d[i] = steps - last_steps[i];
+        last_steps[i] = steps;
+    }
+
+    // midpoint integration of one differential drive step
+    float left = d[0] * mm_per_step;
+    float right = d[1] * mm_per_step;
+    float dist = (left + right) * 0.5f;
+    float dtheta = (right - left) / robot.wheel_base_mm;
+    float mid = state.heading + dtheta * 0.5f;
+
+    state.x_mm += dist * cosf(mid);
+    state.y_mm += dist * sinf(mid);
+    state.heading = remainderf(state.heading + dtheta, 2.0f * (float)M_PI);
+    state.t_us = micros();
+    published.write(state);
+
+    if (ODOM_REPORT_HZ && ++report_div >= ODOM_HZ / ODOM_REPORT_HZ)
+    {
+        uint8_t payload[PROTO_MAX_PAYLOAD];
+        report_div = 0;
+        link_send(payload, odometry_encode(payload, state));
+    }
+}
+
+void odometry_init()
+{
+    for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+        last_steps[i] = stepper_steps(i);
+    published.write(state);
+
+    esp_timer_create_args_t args = {};
+    args.callback = odometry_tick;
+    args.name = "odometry";
+    esp_timer_create(&args, &timer);
+    esp_timer_start_periodic(timer, 1000000 / ODOM_HZ);
+}
+
+bool odometry_get(pose &p)
+{
+    return published.try_read(p);
+}
+
+void odometry_set(float x_mm, float y_mm, float heading)
+{
+    pose p = {x_mm, y_mm, heading, 0};
+    requested.write(p);
+}
+
+uint8_t odometry_encode(uint8_t * out, const pose &p)
+{
+    uint8_t * o = out;
+    *o++ = OP_POSE;
+    o = proto_put_u32(o, (int32_t)lroundf(p.x_mm));
+    o = proto_put_u32(o, (int32_t)lroundf(p.y_mm));
+    o = proto_put_u16(o, (int16_t)lroundf(p.heading * (18000.0f / (float)M_PI)));
+    return o - out;
+}
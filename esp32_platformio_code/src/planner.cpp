@@ -0,0 +1,102 @@
+#include "planner.h"
+
+void planner_init(planner_state &s)
+{
+    s.spin = 0;
+}
+
+static int32_t clearance(const planner_config &cfg, const range_reading &r)
+{
+    int32_t mm = r.confidence < cfg.min_confidence ? cfg.slow_mm : r.mm;
+    return mm > cfg.clear_mm ? cfg.clear_mm : mm;
+}
+
+static int32_t iabs(int32_t v)
+{
+    return v < 0 ? -v : v;
+}
+
+planner_output planner_update(planner_state &s, const planner_config &cfg,
+                              const range_reading * ranges)
+{
+    int32_t free_mm[SENSOR_COUNT];
+    int32_t front = cfg.clear_mm;
+    int32_t left = 0;
+    int32_t right = 0;
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        free_mm[i] = clearance(cfg, ranges[i]);
+        if (iabs(cfg.bearing_deg[i]) <= cfg.front_deg && free_mm[i] < front)
+            front = free_mm[i];
+        if (cfg.bearing_deg[i] < 0)
+            left += free_mm[i];
+        else if (cfg.bearing_deg[i] > 0)
+            right += free_mm[i];
+    }
+
+    // a sector is only as open as the narrower of itself and its
+    // neighbours' average, the robot is wider than one sonar cone
+    int32_t best = -1;
+    int32_t best_score = 0;
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        int32_t side = 0;
+        uint8_t n = 0;
+        if (i > 0)
+            side += free_mm[i - 1], n++;
+        if (i + 1 < SENSOR_COUNT)
+            side += free_mm[i + 1], n++;
+        int32_t open = free_mm[i];
+        if (n && side / n < open)
+            open = side / n;
+        if (free_mm[i] <= cfg.stop_mm)
+            continue;
+
+        int32_t score = open - iabs(cfg.bearing_deg[i]) * cfg.bearing_cost;
+        if (best < 0 || score > best_score)
+        {
+            best = i;
+            best_score = score;
+        }
+    }
+
+    planner_output out = {};
+
+    // spin until the front is properly clear again, not just unblocked
+    if (s.spin && front >= cfg.slow_mm)
+        s.spin = 0;
+    if (!s.spin && best < 0)
+        s.spin = right >= left ? 1 : -1;
+    if (s.spin)
+    {
+        out.turn = s.spin * cfg.max_turn;
+        out.motion = 's';
+        return out;
+    }
+
+    int32_t bearing = cfg.bearing_deg[best];
+    int32_t turn = (bearing * cfg.turn_gain) >> 8;
+    if (turn > cfg.max_turn)
+        turn = cfg.max_turn;
+    if (turn < -cfg.max_turn)
+        turn = -cfg.max_turn;
+
+    // forward speed follows the clearance ahead and drops off the further
+    // the chosen sector is from straight on
+    int32_t forward = 0;
+    if (front > cfg.stop_mm)
+    {
+        forward = cfg.max_forward;
+        if (front < cfg.slow_mm)
+            forward = forward * (front - cfg.stop_mm) / (cfg.slow_mm - cfg.stop_mm);
+        forward = forward * (90 - iabs(bearing)) / 90;
+        if (forward < 0)
+            forward = 0;
+    }
+
+    out.forward = forward;
+    out.turn = turn;
+    out.motion = turn == 0 ? 'f' : turn < 0 ? 'l' : 'r';
+    return out;
+}
@@ -0,0 +1,133 @@
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "link.h"
+#include "profiler.h"
+#include "protocol.h"
+
+struct prof_stats
+{
+    uint32_t count;
+    uint64_t total;     // cycles
+    uint32_t max;
+    uint16_t buckets[PROF_BUCKETS];     // saturate at 0xFFFF
+};
+
+struct prof_event
+{
+    uint32_t start;     // CCOUNT of the core the event ran on
+    uint32_t cycles;
+    uint8_t point;
+};
+
+// an ISR can preempt a task on the same core, but the two never record the
+// same point, so only the trace slot has to be claimed atomically
+static prof_stats stats[portNUM_PROCESSORS][PROF_POINTS];
+static prof_event trace[portNUM_PROCESSORS][PROF_TRACE_LEN];
+static std::atomic<uint32_t> trace_head[portNUM_PROCESSORS];
+
+static uint8_t IRAM_ATTR prof_bucket(uint32_t cycles)
+{
+    uint8_t b = cycles ? 31 - __builtin_clz(cycles) : 0;
+    b = b > 6 ? b - 6 : 0;
+    return b < PROF_BUCKETS ? b : PROF_BUCKETS - 1;
+}
+
+void IRAM_ATTR prof_record(uint8_t point, uint32_t start, uint32_t cycles)
+{
+    uint8_t core = xPortGetCoreID();
+    prof_stats &s = stats[core][point];
+
+    s.count++;
+    s.total += cycles;
+    if (cycles > s.max)
+        s.max = cycles;
+    if (s.buckets[prof_bucket(cycles)] != 0xFFFF)
+        s.buckets[prof_bucket(cycles)]++;
+
+    prof_event &e = trace[core][trace_head[core].fetch_add(1) % PROF_TRACE_LEN];
+    e.start = start;
+    e.cycles = cycles;
+    e.point = point;
+}
+
+prof_totals prof_get(uint8_t point)
+{
+    prof_totals t = {};
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        const prof_stats &s = stats[core][point];
+        t.count += s.count;
+        t.cycles += s.total;
+        if (s.max > t.max)
+            t.max = s.max;
+    }
+    return t;
+}
+
+void prof_dump(uint8_t flags)
+{
+    uint32_t mhz = getCpuFrequencyMhz();
+
+    for (uint8_t point = 0; point < PROF_POINTS; point++)
+    {
+        prof_stats sum = {};
+        uint32_t buckets[PROF_BUCKETS] = {};
+        for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            const prof_stats &s = stats[core][point];
+            sum.count += s.count;
+            sum.total += s.total;
+            if (s.max > sum.max)
+                sum.max = s.max;
+            for (uint8_t b = 0; b < PROF_BUCKETS; b++)
+                buckets[b] += s.buckets[b];
+        }
+        if (!sum.count)
+            continue;
+
+        uint8_t out[1 + PROFILE_LEN] = {OP_PROFILE, point};
+        uint8_t * p = &out[2];
+        p = proto_put_u32(p, sum.count);
+        p = proto_put_u32(p, sum.total / mhz);
+        p = proto_put_u32(p, sum.max);
+        for (uint32_t b : buckets)
+            p = proto_put_u16(p, b > 0xFFFF ? 0xFFFF : b);
+        link_send(out, p - out);
+    }
+
+    if (flags & PROF_DUMP_TRACE)
+    {
+        for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            uint8_t out[PROTO_MAX_PAYLOAD];
+            uint8_t n = 0;
+            for (const prof_event &e : trace[core])
+            {
+                if (!e.cycles)
+                    continue;
+                uint8_t * p = &out[n];
+                *p++ = OP_TRACE;
+                *p++ = core;
+                *p++ = e.point;
+                p = proto_put_u32(p, e.start);
+                p = proto_put_u32(p, e.cycles);
+                n = p - out;
+                if (n + 1 + TRACE_LEN > PROTO_MAX_PAYLOAD)
+                {
+                    link_send(out, n);
+                    n = 0;
+                }
+            }
+            if (n)
+                link_send(out, n);
+        }
+    }
+
+    if (flags & PROF_DUMP_RESET)
+    {
+        memset(stats, 0, sizeof(stats));
+        memset(trace, 0, sizeof(trace));
+    }
+}
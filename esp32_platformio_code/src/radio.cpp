@@ -0,0 +1,268 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "radio.h"
+
+static radio_stats stats;
+
+#if !RADIO_ENABLED
+
+void radio_init()
+{
+}
+
+#else
+
+#if defined(RADIO_ESPNOW) && defined(RADIO_UDP)
+#error "build with one of RADIO_ESPNOW and RADIO_UDP"
+#endif
+
+#include <WiFi.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
+#include <freertos/ringbuf.h>
+#ifdef RADIO_ESPNOW
+#include <esp_now.h>
+#include <esp_wifi.h>
+#else
+#include <lwip/sockets.h>
+#include <mbedtls/md.h>
+#endif
+
+#include "link.h"
+
+static QueueHandle_t frames;
+static RingbufHandle_t tx_ring;
+static uint8_t transport;
+
+#ifdef RADIO_ESPNOW
+static const uint8_t peer[ESP_NOW_ETH_ALEN] = {RADIO_PEER_MAC};
+static_assert(sizeof(RADIO_PMK) == ESP_NOW_KEY_LEN + 1, "RADIO_PMK is 16 characters");
+static_assert(sizeof(RADIO_LMK) == ESP_NOW_KEY_LEN + 1, "RADIO_LMK is 16 characters");
+#else
+static int sock = -1;
+static in_addr_t peer_ip;
+// the peer's address with the port it last sent from, written where packets
+// land, read by the TX task
+static portMUX_TYPE peer_lock = portMUX_INITIALIZER_UNLOCKED;
+static sockaddr_in peer;
+static bool peer_heard = false;
+static const mbedtls_md_info_t * sha256;
+static uint64_t rx_counter = 0;     // newest the peer used, RX task only
+static uint64_t tx_counter = 0;     // TX task only
+static_assert(sizeof(RADIO_UDP_KEY) > 16, "RADIO_UDP_KEY is at least 16 characters");
+#endif
+
+// radio_packet queues every valid frame of one datagram, a frame never
+// spans two of them. from() runs before the first one is queued, so the
+// replies to it already find their peer.
+template <typename F>
+static void radio_packet(const uint8_t * data, int len, F &&from)
+{
+    proto_parser parser = {};
+    proto_parser_reset(parser);
+    bool valid = false;
+
+    for (int i = 0; i < len; i++)
+    {
+        if (!proto_feed(parser, data[i]))
+            continue;
+        if (!valid)
+            from();
+        valid = true;
+
+        link_rx rx;
+        rx.frame = parser.frame;
+        rx.rx_us = esp_timer_get_time();
+        rx.transport = transport;
+        if (xQueueSend(frames, &rx, 0) == pdTRUE)
+            stats.frames++;
+        else
+            stats.dropped++;
+    }
+    if (!valid)
+        stats.bad_packets++;
+}
+
+#ifdef RADIO_ESPNOW
+
+// runs in the WiFi task
+static void radio_espnow_rx(const uint8_t * mac, const uint8_t * data, int len)
+{
+    if (memcmp(mac, peer, sizeof(peer)))
+    {
+        stats.foreign++;
+        return;
+    }
+    radio_packet(data, len, [] {});
+}
+
+static bool radio_transmit(const uint8_t * data, size_t len)
+{
+    return esp_now_send(peer, data, len) == ESP_OK;
+}
+
+#else
+
+static void udp_tag(const uint8_t * data, size_t len, uint8_t * tag)
+{
+    uint8_t mac[32];
+    mbedtls_md_hmac(sha256, (const uint8_t *)RADIO_UDP_KEY, sizeof(RADIO_UDP_KEY) - 1, data, len, mac);
+    memcpy(tag, mac, RADIO_UDP_TAG_LEN);
+}
+
+// udp_authentic checks the tag of a datagram and that its counter is newer
+// than any the peer used before, so a captured one cannot be played again
+static bool udp_authentic(const uint8_t * data, int len)
+{
+    if (len <= RADIO_UDP_COUNTER_LEN + RADIO_UDP_TAG_LEN)
+        return false;
+    uint8_t tag[RADIO_UDP_TAG_LEN];
+    udp_tag(data, len - RADIO_UDP_TAG_LEN, tag);
+    // in constant time, a mismatch must not tell how much of the tag was right
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < RADIO_UDP_TAG_LEN; i++)
+        diff |= tag[i] ^ data[len - RADIO_UDP_TAG_LEN + i];
+    if (diff)
+        return false;
+
+    uint64_t counter = proto_get_u32(data) | (uint64_t)proto_get_u32(data + 4) << 32;
+    if (counter <= rx_counter)
+        return false;
+    rx_counter = counter;
+    return true;
+}
+
+static void radio_udp_rx_task(void * parameter)
+{
+    uint8_t buf[RADIO_PACKET];
+
+    while (1)
+    {
+        sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int n = recvfrom(sock, buf, sizeof(buf), 0, (sockaddr *)&from, &from_len);
+        if (n <= 0)
+        {
+            vTaskDelay(1);
+            continue;
+        }
+        if (from.sin_addr.s_addr != peer_ip)
+        {
+            stats.foreign++;
+            continue;
+        }
+        if (!udp_authentic(buf, n))
+        {
+            stats.bad_tags++;
+            continue;
+        }
+        radio_packet(buf + RADIO_UDP_COUNTER_LEN, n - RADIO_UDP_COUNTER_LEN - RADIO_UDP_TAG_LEN, [&from] {
+            portENTER_CRITICAL(&peer_lock);
+            peer = from;
+            peer_heard = true;
+            portEXIT_CRITICAL(&peer_lock);
+        });
+    }
+}
+
+static bool radio_transmit(const uint8_t * data, size_t len)
+{
+    sockaddr_in to;
+    bool heard;
+
+    portENTER_CRITICAL(&peer_lock);
+    to = peer;
+    heard = peer_heard;
+    portEXIT_CRITICAL(&peer_lock);
+    if (!heard)
+        return false;
+
+    uint8_t packet[RADIO_UDP_COUNTER_LEN + PROTO_MAX_FRAME + RADIO_UDP_TAG_LEN];
+    if (len > PROTO_MAX_FRAME)
+        return false;
+    tx_counter++;
+    proto_put_u32(proto_put_u32(packet, tx_counter), tx_counter >> 32);
+    memcpy(&packet[RADIO_UDP_COUNTER_LEN], data, len);
+    size_t n = RADIO_UDP_COUNTER_LEN + len;
+    udp_tag(packet, n, &packet[n]);
+    n += RADIO_UDP_TAG_LEN;
+    return sendto(sock, packet, n, 0, (const sockaddr *)&to, sizeof(to)) == (int)n;
+}
+
+#endif
+
+// link_send hands frames over here, one ring item per frame, so each one
+// leaves as a datagram of its own
+static bool radio_send(const uint8_t * frame, size_t len)
+{
+    if (xRingbufferSend(tx_ring, frame, len, 0) == pdTRUE)
+        return true;
+    stats.tx_dropped++;
+    return false;
+}
+
+static void radio_tx_task(void * parameter)
+{
+    while (1)
+    {
+        size_t n;
+        void * data = xRingbufferReceive(tx_ring, &n, portMAX_DELAY);
+        if (!data)
+            continue;
+        if (!radio_transmit((const uint8_t *)data, n))
+            stats.tx_errors++;
+        vRingbufferReturnItem(tx_ring, data);
+    }
+}
+
+void radio_init()
+{
+    frames = xQueueCreate(LINK_FRAME_QUEUE, sizeof(link_rx));
+    tx_ring = xRingbufferCreate(RADIO_TX_QUEUE, RINGBUF_TYPE_NOSPLIT);
+    transport = link_add_transport(frames, radio_send);
+    if (!transport)
+        return;
+
+    // modem sleep would hold incoming packets for up to a beacon interval
+    WiFi.mode(WIFI_STA);
+    WiFi.setSleep(false);
+
+#ifdef RADIO_ESPNOW
+    esp_wifi_set_channel(RADIO_CHANNEL, WIFI_SECOND_CHAN_NONE);
+    esp_now_init();
+    esp_now_set_pmk((const uint8_t *)RADIO_PMK);
+
+    // the bridge is the only peer, and an encrypted one
+    esp_now_peer_info_t info = {};
+    memcpy(info.peer_addr, peer, sizeof(peer));
+    memcpy(info.lmk, RADIO_LMK, ESP_NOW_KEY_LEN);
+    info.channel = RADIO_CHANNEL;
+    info.ifidx = WIFI_IF_STA;
+    info.encrypt = true;
+    esp_now_add_peer(&info);
+    esp_now_register_recv_cb(radio_espnow_rx);
+#else
+    peer_ip = inet_addr(RADIO_PEER_IP);
+    sha256 = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+
+    // the station reconnects on its own, the socket outlives any outage
+    WiFi.begin(RADIO_SSID, RADIO_PASSWORD);
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(RADIO_UDP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    bind(sock, (const sockaddr *)&addr, sizeof(addr));
+    xTaskCreatePinnedToCore(radio_udp_rx_task, "RadioRx", RADIO_RX_STACK, NULL, RADIO_RX_PRIORITY, NULL, 0);
+#endif
+
+    xTaskCreatePinnedToCore(radio_tx_task, "RadioTx", RADIO_TX_STACK, NULL, RADIO_TX_PRIORITY, NULL, 0);
+}
+
+#endif
+
+const radio_stats &radio_get_stats()
+{
+    return stats;
+}
@@ -0,0 +1,80 @@
+#include "range_filter.h"
+#include "ultrasonic.h"
+
+void range_filter_init(range_filter &f, const range_filter_config &cfg)
+{
+    f.count = 0;
+    f.next = 0;
+    f.pending = 0;
+    f.state = (int32_t)cfg.far_mm << 4;
+    f.out.mm = cfg.far_mm;
+    f.out.confidence = 0;
+}
+
+static uint16_t median(const range_filter &f)
+{
+    uint16_t sorted[RANGE_MEDIAN_MAX];
+
+    for (uint8_t i = 0; i < f.count; i++)
+    {
+        uint16_t v = f.window[i];
+        uint8_t j = i;
+        for (; j > 0 && sorted[j - 1] > v; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+    return sorted[f.count / 2];
+}
+
+range_reading range_filter_update(range_filter &f, const range_filter_config &cfg,
+                                  uint8_t status, uint32_t echo_us)
+{
+    uint8_t &conf = f.out.confidence;
+    uint16_t mm;
+
+    switch (status) {
+        case ECHO_OK:
+            mm = echo_to_mm(echo_us);
+            if (mm > cfg.far_mm)
+                mm = cfg.far_mm;
+            break;
+        case ECHO_OUT_OF_RANGE:
+            mm = cfg.far_mm;
+            break;
+        default:
+            conf -= conf >> 2;
+            return f.out;
+    }
+
+    f.window[f.next] = mm;
+    f.next = (f.next + 1) % cfg.median;
+    if (f.count < cfg.median)
+        f.count++;
+
+    int32_t m = (int32_t)median(f) << 4;
+    int32_t diff = m - f.state;
+    int32_t limit = (int32_t)cfg.outlier_mm << 4;
+
+    if (conf == 0)
+    {
+        // nothing to trust yet, take the sample as it is
+        f.state = m;
+    } else if (diff > limit || diff < -limit)
+    {
+        if (++f.pending < cfg.outlier_confirm)
+        {
+            conf -= conf >> 3;
+            return f.out;
+        }
+        // the jump is real, follow it at once instead of easing into it
+        f.state = m;
+    } else
+    {
+        f.state += (diff * cfg.alpha) >> 8;
+    }
+
+    f.pending = 0;
+    conf += (255 - conf + 3) >> 2;
+    f.out.mm = f.state >> 4;
+    return f.out;
+}
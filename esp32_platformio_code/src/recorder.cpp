@@ -0,0 +1,287 @@
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "link.h"
+#include "protocol.h"
+#include "recorder.h"
+#include "stepper.h"
+
+#define REC_SECTOR 4096
+#define REC_PAGE 256
+#define REC_MAGIC 0x52584453    // "SDXR"
+#define REC_VERSION 1
+#define REC_PER_BLOCK (REC_SECTOR / sizeof(rec_record) - 1)
+
+// takes the first record slot of a sector
+struct rec_header
+{
+    uint32_t magic;
+    uint32_t seq;       // blocks written before this one, ever
+    uint32_t dropped;   // rec_dropped when it was written
+    uint16_t count;
+    uint16_t version;
+};
+
+struct rec_block
+{
+    rec_header header;
+    rec_record records[REC_PER_BLOCK];
+};
+
+static_assert(sizeof(rec_header) == sizeof(rec_record), "the header takes one record slot");
+static_assert(sizeof(rec_block) == REC_SECTOR, "a block fills one flash sector");
+
+// Record i goes to slot i % REC_PER_BLOCK of RAM block i / REC_PER_BLOCK,
+// modulo the ring. A producer only reserves an index whose block has been
+// flushed since its last lap, so a block is never written and flushed at
+// once.
+static rec_block ram[REC_RAM_BLOCKS];
+static std::atomic<uint32_t> head{0};           // records reserved
+static std::atomic<uint32_t> flushed{0};        // records of finished blocks
+static std::atomic<uint16_t> filled[REC_RAM_BLOCKS];
+static std::atomic<uint32_t> dropped{0};
+static std::atomic<int32_t> dump_request{-1};
+
+// only the recorder task touches these
+static const esp_partition_t * part;
+static uint32_t sectors;
+static uint32_t next_sector;        // where the next block goes
+static uint32_t next_seq;
+static uint32_t erased_ahead = 0;   // blank sectors from next_sector on
+static rec_block scratch;           // a sector read back for a dump
+
+void rec_log(uint8_t type, uint8_t a, uint16_t b, int32_t c, int32_t d)
+{
+    uint32_t i = head.load(std::memory_order_relaxed);
+    do
+    {
+        if (i - flushed.load(std::memory_order_acquire) >= REC_RAM_BLOCKS * REC_PER_BLOCK)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } while (!head.compare_exchange_weak(i, i + 1, std::memory_order_relaxed));
+
+    uint32_t block = i / REC_PER_BLOCK % REC_RAM_BLOCKS;
+    rec_record &r = ram[block].records[i % REC_PER_BLOCK];
+    r.t_us = micros();
+    r.a = a;
+    r.b = b;
+    r.c = c;
+    r.d = d;
+    __atomic_store_n(&r.type, type, __ATOMIC_RELEASE);
+    filled[block].fetch_add(1, std::memory_order_release);
+}
+
+void rec_dump(uint16_t blocks)
+{
+    dump_request = blocks;
+}
+
+uint32_t rec_dropped()
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+static bool wheels_still()
+{
+    for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+        if (stepper_rate(i) || stepper_output_rate(i))
+            return false;
+    return true;
+}
+
+static bool sector_blank(uint32_t sector)
+{
+    uint32_t buf[REC_PAGE / 4];
+
+    for (uint32_t off = 0; off < REC_SECTOR; off += REC_PAGE)
+    {
+        esp_partition_read(part, sector * REC_SECTOR + off, buf, REC_PAGE);
+        for (uint32_t w : buf)
+            if (w != 0xFFFFFFFF)
+                return false;
+    }
+    return true;
+}
+
+static void erase_ahead()
+{
+    uint32_t sector = (next_sector + erased_ahead) % sectors;
+    esp_partition_erase_range(part, sector * REC_SECTOR, REC_SECTOR);
+    erased_ahead++;
+}
+
+// write_block programs a full RAM block into the next sector, which must
+// be blank. One page at a time, so each write holds the cores up only for
+// a single page program. The page with the header goes last: until it is
+// written the sector has no magic, so a block torn by a reset is skipped,
+// and erased before reuse, rather than read back half blank.
+static void write_block(rec_block &b)
+{
+    b.header = {REC_MAGIC, next_seq, rec_dropped(), (uint16_t)REC_PER_BLOCK, REC_VERSION};
+    uint32_t at = next_sector * REC_SECTOR;
+    for (uint32_t off = REC_PAGE; off <= REC_SECTOR; off += REC_PAGE)
+    {
+        uint32_t page = off % REC_SECTOR;
+        esp_partition_write(part, at + page, (const uint8_t *)&b + page, REC_PAGE);
+        vTaskDelay(1);
+    }
+    next_sector = (next_sector + 1) % sectors;
+    next_seq++;
+    erased_ahead--;
+}
+
+static void flush_ready()
+{
+    while (1)
+    {
+        uint32_t first = flushed.load(std::memory_order_relaxed);
+        uint32_t block = first / REC_PER_BLOCK % REC_RAM_BLOCKS;
+        if (filled[block].load(std::memory_order_acquire) < REC_PER_BLOCK)
+            return;
+
+        if (part)
+        {
+            // out of blank sectors an erase waits for the wheels to stop,
+            // unless the ring is about to overflow
+            if (!erased_ahead)
+            {
+                bool full = head.load() - first >= (REC_RAM_BLOCKS - 1) * REC_PER_BLOCK;
+                if (!full && !wheels_still())
+                    return;
+                erase_ahead();
+            }
+            write_block(ram[block]);
+        }
+
+        for (rec_record &r : ram[block].records)
+            r.type = REC_NONE;
+        filled[block] = 0;
+        flushed.fetch_add(REC_PER_BLOCK, std::memory_order_release);
+    }
+}
+
+// three records to a frame
+struct dump_out
+{
+    uint8_t payload[PROTO_MAX_PAYLOAD];
+    uint8_t len = 0;
+    uint32_t sent = 0;
+
+    void flush()
+    {
+        if (len && link_send_wait(payload, len, pdMS_TO_TICKS(REC_DUMP_WAIT_MS)))
+            sent += len / (1 + RECORD_LEN);
+        len = 0;
+    }
+
+    void add(uint32_t index, const rec_record &r)
+    {
+        if (len + 1 + RECORD_LEN > (int)sizeof(payload))
+            flush();
+        uint8_t * p = &payload[len];
+        *p++ = OP_RECORD;
+        p = proto_put_u32(p, index);
+        p = proto_put_u32(p, r.t_us);
+        *p++ = r.type;
+        *p++ = r.a;
+        p = proto_put_u16(p, r.b);
+        p = proto_put_u32(p, r.c);
+        p = proto_put_u32(p, r.d);
+        len = p - payload;
+    }
+};
+
+static void stream(uint16_t blocks)
+{
+    dump_out out;
+
+    uint32_t n = part ? (next_seq < sectors ? next_seq : sectors) : 0;
+    if (blocks && blocks < n)
+        n = blocks;
+    for (uint32_t k = n; k > 0; k--)
+    {
+        uint32_t seq = next_seq - k;
+        uint32_t sector = (next_sector + sectors - k) % sectors;
+        esp_partition_read(part, sector * REC_SECTOR, &scratch, REC_SECTOR);
+        // erased ahead or never written
+        if (scratch.header.magic != REC_MAGIC || scratch.header.seq != seq)
+            continue;
+        for (uint16_t i = 0; i < scratch.header.count && i < REC_PER_BLOCK; i++)
+            out.add(seq * REC_PER_BLOCK + i, scratch.records[i]);
+    }
+
+    // then what has not reached flash yet, up to a slot still being filled
+    uint32_t first = flushed.load(std::memory_order_acquire);
+    uint32_t last = head.load();
+    for (uint32_t i = first; i != last; i++)
+    {
+        const rec_record &r = ram[i / REC_PER_BLOCK % REC_RAM_BLOCKS].records[i % REC_PER_BLOCK];
+        if (__atomic_load_n(&r.type, __ATOMIC_ACQUIRE) == REC_NONE)
+            break;
+        out.add(next_seq * REC_PER_BLOCK + (i - first), r);
+    }
+    out.flush();
+
+    uint8_t done[1 + 8] = {OP_RECORDER_DONE};
+    proto_put_u32(proto_put_u32(&done[1], out.sent), rec_dropped());
+    link_send_wait(done, sizeof(done), pdMS_TO_TICKS(REC_DUMP_WAIT_MS));
+}
+
+static void recorder_task(void * parameter)
+{
+    while (1)
+    {
+        int32_t dump = dump_request.exchange(-1);
+        if (dump >= 0)
+            stream(dump);
+
+        flush_ready();
+
+        // one erase per pass, and only with the wheels still
+        if (part && erased_ahead < REC_ERASE_AHEAD && erased_ahead < sectors - 1 && wheels_still())
+            erase_ahead();
+
+        vTaskDelay(pdMS_TO_TICKS(REC_FLUSH_MS));
+    }
+}
+
+void rec_init()
+{
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)REC_PARTITION_SUBTYPE,
+                                    "recorder");
+    if (part)
+    {
+        sectors = part->size / REC_SECTOR;
+
+        bool found = false;
+        rec_header h;
+        for (uint32_t s = 0; s < sectors; s++)
+        {
+            esp_partition_read(part, s * REC_SECTOR, &h, sizeof(h));
+            if (h.magic != REC_MAGIC || (found && (int32_t)(h.seq - next_seq) < 0))
+                continue;
+            found = true;
+            next_seq = h.seq;
+            next_sector = s;
+        }
+        if (found)
+        {
+            next_seq++;
+            next_sector = (next_sector + 1) % sectors;
+        }
+
+        // blank sectors left from the last run count as erased ahead,
+        // checked whole in case power went during an erase
+        while (erased_ahead < REC_ERASE_AHEAD && erased_ahead < sectors - 1
+               && sector_blank((next_sector + erased_ahead) % sectors))
+            erased_ahead++;
+    }
+
+    rec_log(REC_BOOT, 0, 0, part ? sectors : 0, next_seq);
+    xTaskCreatePinnedToCore(recorder_task, "Recorder", REC_STACK, NULL, REC_PRIORITY, NULL, 0);
+}
@@ -0,0 +1,179 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "link.h"
+#include "protocol.h"
+#include "segments.h"
+#include "spsc_ring.h"
+
+static spsc_ring<segment, SEGMENT_QUEUE> queue;
+
+// segments_clear bumps gen and the control loop drops every segment pushed
+// before. The lock keeps a clear from landing between the control loop's
+// check of gen and its rate writes, so the caller's own rates always win.
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t gen = 0;
+
+// only the control loop touches these
+static uint32_t seen_gen = 0;
+static segment current;
+static bool active = false;
+static bool linked = false;         // goals carry on from the last segment
+static int32_t goal[STEPPER_COUNT];
+static bool exact[STEPPER_COUNT];   // stepper_stop_at armed for goal
+
+struct report
+{
+    uint16_t id;
+    uint8_t status;
+};
+
+static int8_t sign(int32_t v)
+{
+    return (v > 0) - (v < 0);
+}
+
+bool segments_push(segment s)
+{
+    for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+        if (s.rate[i] < STEPPER_CRAWL_RATE)
+            s.rate[i] = STEPPER_CRAWL_RATE;
+    s.gen = gen;
+    return queue.push(s);
+}
+
+void segments_clear()
+{
+    portENTER_CRITICAL(&lock);
+    gen++;
+    for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+        stepper_cancel_goal(i);
+    portEXIT_CRITICAL(&lock);
+}
+
+uint8_t segments_free()
+{
+    return SEGMENT_QUEUE - queue.size();
+}
+
+static bool start()
+{
+    if (!queue.pop(current))
+        return false;
+
+    for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+    {
+        if (!linked)
+            goal[i] = stepper_steps(i);
+        goal[i] += current.steps[i];
+        exact[i] = false;
+    }
+    active = true;
+    return true;
+}
+
+static int32_t remaining(uint8_t i)
+{
+    return (goal[i] - stepper_steps(i)) * sign(current.steps[i]);
+}
+
+// end_rate is the rate a wheel may still have when the running segment
+// ends: the next one's cruise rate if it carries on the same way, 0 if the
+// wheel has to stop on its goal
+static uint32_t end_rate(uint8_t i)
+{
+    segment next;
+    int8_t dir = sign(current.steps[i]);
+    if (dir == 0 || !queue.peek(next) || next.gen != seen_gen || sign(next.steps[i]) != dir)
+        return 0;
+    return next.rate[i];
+}
+
+// wheel_rate returns the signed rate for one wheel of the running segment
+// and arms or drops its exact stop as the look-ahead changes
+static int32_t wheel_rate(uint8_t i)
+{
+    int8_t dir = sign(current.steps[i]);
+    uint32_t end = end_rate(i);
+
+    if (end == 0 && !exact[i] && dir)
+    {
+        stepper_stop_at(i, goal[i]);
+        exact[i] = true;
+    } else if (end && exact[i])
+    {
+        stepper_cancel_goal(i);
+        exact[i] = false;
+    }
+
+    int32_t left = remaining(i);
+    if (left <= 0)
+        return dir * (int32_t)end;
+
+    uint32_t rate = current.rate[i];
+    uint32_t floor = rate < STEPPER_CRAWL_RATE ? rate : STEPPER_CRAWL_RATE;
+    if (end > floor)
+        floor = end;
+
+    // brakes toward the end rate, the last steps go at crawl speed so the
+    // exact stop on the goal step is a gentle one
+    int32_t out = stepper_output_rate(i);
+    uint32_t speed = out < 0 ? -out : out;
+    if (floor < rate && (uint32_t)left <= stepper_brake_steps(speed, floor))
+        rate = floor;
+    return dir * (int32_t)rate;
+}
+
+void segments_run()
+{
+    report reports[SEGMENT_QUEUE + 1];
+    uint8_t count = 0;
+
+    portENTER_CRITICAL(&lock);
+    if (gen != seen_gen)
+    {
+        seen_gen = gen;
+        linked = false;
+        if (active)
+            reports[count++] = {current.id, SEGMENT_CANCELLED};
+        active = false;
+
+        segment s;
+        while (queue.peek(s) && s.gen != seen_gen)
+        {
+            queue.pop(s);
+            reports[count++] = {s.id, SEGMENT_CANCELLED};
+        }
+    }
+
+    // a finished segment hands over to the next one in the same tick, so
+    // carried rates see no gap
+    while ((active || start()) && count < SEGMENT_QUEUE + 1)
+    {
+        int32_t rates[STEPPER_COUNT];
+        bool finished = true;
+        for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+        {
+            rates[i] = wheel_rate(i);
+            if (remaining(i) > 0)
+                finished = false;
+        }
+        stepper_set_rates(rates[0], rates[1]);
+
+        if (!finished)
+            break;
+        reports[count++] = {current.id, SEGMENT_DONE};
+        active = false;
+        linked = true;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t msg[1 + 4] = {OP_SEGMENT_STATUS};
+        uint8_t * p = proto_put_u16(&msg[1], reports[i].id);
+        *p++ = reports[i].status;
+        *p = segments_free();
+        link_send(msg, sizeof(msg));
+    }
+}
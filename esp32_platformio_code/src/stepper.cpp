@@ -0,0 +1,343 @@
+#include <Arduino.h>
+#include <driver/mcpwm.h>
+#include <driver/pcnt.h>
+#include <soc/gpio_periph.h>
+
+#include "config.h"
+#include "gpio_fast.h"
+#include "ramp.h"
+#include "stepper.h"
+
+struct stepper
+{
+    uint8_t en_pin;
+    uint8_t dir_pin;
+    uint8_t pul_pin;
+    uint8_t fwd_level;        // DIR level that turns the wheel forward
+    mcpwm_timer_t timer;
+    pcnt_unit_t pcnt;         // counts the pulses MCPWM actually emitted
+
+    volatile int32_t target;  // requested rate, steps/s
+    volatile bool release;    // disable the driver once the wheel is stopped
+    ramp_state ramp;
+
+    uint32_t out_rate;        // frequency on the PUL pin, 0 = pulse train off
+    int8_t out_dir;           // direction currently latched on the DIR pin
+
+    int16_t pcnt_last;
+    volatile int32_t steps;   // signed step total since boot
+
+    volatile bool exact;      // stop the pulse train on the step that reaches goal
+    volatile bool at_goal;
+    bool armed;               // PCNT threshold programmed for goal
+    int32_t goal;
+};
+
+#define MOTOR(i, timer, pcnt) \
+    {robot.motors[i].en, robot.motors[i].dir, robot.motors[i].pul, robot.motors[i].fwd_level, timer, pcnt}
+
+static stepper motors[STEPPER_COUNT] = {
+    MOTOR(0, MCPWM_TIMER_0, PCNT_UNIT_0),
+    MOTOR(1, MCPWM_TIMER_1, PCNT_UNIT_1),
+};
+
+// the PCNT counters wrap from STEP_COUNT_WRAP back to 0
+#define STEP_COUNT_WRAP 32767
+
+static ramp_limits limits;
+static uint32_t accel = STEPPER_ACCEL;
+static uint32_t jerk = STEPPER_JERK;
+
+// taken by the tick around each wheel's update and by the goal ISR, which
+// stops a pulse train behind the tick's back
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void pulse_off(stepper &m)
+{
+    mcpwm_set_signal_low(MCPWM_UNIT_0, m.timer, MCPWM_OPR_A);
+    mcpwm_stop(MCPWM_UNIT_0, m.timer);
+    m.out_rate = 0;
+}
+
+static void pulse_rate(stepper &m, uint32_t rate)
+{
+    mcpwm_set_frequency(MCPWM_UNIT_0, m.timer, rate);
+    if (m.out_rate == 0)
+    {
+        mcpwm_set_duty_type(MCPWM_UNIT_0, m.timer, MCPWM_OPR_A, MCPWM_DUTY_MODE_0);
+        mcpwm_start(MCPWM_UNIT_0, m.timer);
+    }
+    mcpwm_set_duty(MCPWM_UNIT_0, m.timer, MCPWM_OPR_A, 50.0);
+    m.out_rate = rate;
+}
+
+static void halt(stepper &m)
+{
+    pcnt_event_disable(m.pcnt, PCNT_EVT_THRES_0);
+    pulse_off(m);
+    m.ramp.rate = 0;
+    m.ramp.accel = 0;
+    m.target = 0;
+    m.exact = false;
+    m.armed = false;
+    m.at_goal = true;
+}
+
+// stepper_goal is the PCNT threshold interrupt of one wheel. It runs on the
+// edge of the goal step itself, so the train stops exactly there whatever
+// the tick phase. Not in IRAM, it calls into the MCPWM driver.
+static void stepper_goal(void * arg)
+{
+    stepper &m = *(stepper *)arg;
+    uint32_t status = 0;
+
+    pcnt_get_event_status(m.pcnt, &status);
+    if (!(status & PCNT_EVT_THRES_0))
+        return;
+
+    portENTER_CRITICAL_ISR(&lock);
+    if (m.exact && m.armed)
+        halt(m);
+    portEXIT_CRITICAL_ISR(&lock);
+}
+
+// arm_goal programs the threshold once the goal is within one PCNT wrap, a
+// goal already reached or passed stops the wheel right away. A wheel still
+// ramping through a reversal is left alone until it heads for the goal.
+static void arm_goal(stepper &m, int16_t count)
+{
+    if ((m.target < 0 ? -1 : 1) != m.out_dir)
+        return;
+
+    int32_t remaining = (m.goal - m.steps) * m.out_dir;
+
+    if (remaining <= 0)
+    {
+        halt(m);
+        return;
+    }
+    if (remaining >= STEP_COUNT_WRAP)
+        return;
+
+    pcnt_set_event_value(m.pcnt, PCNT_EVT_THRES_0, (count + remaining) % STEP_COUNT_WRAP);
+    pcnt_event_enable(m.pcnt, PCNT_EVT_THRES_0);
+    m.armed = true;
+}
+
+// stepper_update moves one wheel a tick along its ramp. Direction is only
+// ever changed while the pulse train is off, and the first pulse after a
+// change waits one tick so the driver sees a settled DIR line. Pin changes
+// are collected in set/clear so both wheels switch in the same write.
+static void stepper_update(stepper &m, uint32_t &set, uint32_t &clear)
+{
+    // every pulse since the last tick went out with the DIR latched then
+    int16_t count;
+    pcnt_get_counter_value(m.pcnt, &count);
+    int32_t delta = count - m.pcnt_last;
+    if (delta < 0)
+        delta += STEP_COUNT_WRAP;
+    m.pcnt_last = count;
+    m.steps += m.out_dir * delta;
+
+    if (m.exact && !m.armed && m.out_rate)
+    {
+        arm_goal(m, count);
+        if (!m.exact)
+            return;
+    }
+
+    int32_t rate = ramp_update(m.ramp, m.target << RAMP_Q, limits) >> RAMP_Q;
+    uint32_t speed = rate < 0 ? -rate : rate;
+    int8_t dir = rate < 0 ? -1 : 1;
+
+    if (speed < STEPPER_MIN_RATE)
+    {
+        if (m.out_rate)
+            pulse_off(m);
+        if (m.release && m.target == 0)
+            set |= gpio_bit(m.en_pin);
+        return;
+    }
+
+    if (dir != m.out_dir)
+    {
+        if (m.out_rate)
+            pulse_off(m);
+        if ((dir > 0) == (m.fwd_level == HIGH))
+            set |= gpio_bit(m.dir_pin);
+        else
+            clear |= gpio_bit(m.dir_pin);
+        m.out_dir = dir;
+        return;
+    }
+
+    if (speed != m.out_rate)
+        pulse_rate(m, speed);
+}
+
+void stepper_tick()
+{
+    uint32_t set = 0;
+    uint32_t clear = 0;
+
+    for (stepper &m : motors)
+    {
+        portENTER_CRITICAL(&lock);
+        stepper_update(m, set, clear);
+        portEXIT_CRITICAL(&lock);
+    }
+    gpio_fast_write(set, clear);
+}
+
+void stepper_init()
+{
+    limits = ramp_make_limits(STEPPER_ACCEL, STEPPER_JERK, STEPPER_TICK_HZ);
+
+    // PCNT takes its input from the PUL pad itself, so it has to be routed
+    // before MCPWM claims the pad as an output
+    for (stepper &m : motors)
+    {
+        pcnt_config_t pc = {};
+        pc.pulse_gpio_num = m.pul_pin;
+        pc.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+        pc.lctrl_mode = PCNT_MODE_KEEP;
+        pc.hctrl_mode = PCNT_MODE_KEEP;
+        pc.pos_mode = PCNT_COUNT_INC;
+        pc.neg_mode = PCNT_COUNT_DIS;
+        pc.counter_h_lim = STEP_COUNT_WRAP;
+        pc.counter_l_lim = 0;
+        pc.unit = m.pcnt;
+        pc.channel = PCNT_CHANNEL_0;
+        pcnt_unit_config(&pc);
+        pcnt_set_filter_value(m.pcnt, 100);
+        pcnt_filter_enable(m.pcnt);
+        pcnt_counter_clear(m.pcnt);
+        pcnt_counter_resume(m.pcnt);
+    }
+
+    pcnt_isr_service_install(0);
+    for (stepper &m : motors)
+        pcnt_isr_handler_add(m.pcnt, stepper_goal, &m);
+
+    mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM0A, robot.motors[0].pul);
+    mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM1A, robot.motors[1].pul);
+    PIN_INPUT_ENABLE(GPIO_PIN_MUX_REG[robot.motors[0].pul]);
+    PIN_INPUT_ENABLE(GPIO_PIN_MUX_REG[robot.motors[1].pul]);
+
+    mcpwm_config_t cfg = {};
+    cfg.frequency = 1000;
+    cfg.cmpr_a = 50.0;
+    cfg.cmpr_b = 0;
+    cfg.duty_mode = MCPWM_DUTY_MODE_0;
+    cfg.counter_mode = MCPWM_UP_COUNTER;
+
+    for (stepper &m : motors)
+    {
+        pinMode(m.en_pin, OUTPUT);
+        pinMode(m.dir_pin, OUTPUT);
+        digitalWrite(m.en_pin, HIGH);
+        digitalWrite(m.dir_pin, m.fwd_level);
+        m.out_dir = 1;
+
+        // mcpwm_init starts the timer, keep the line low until a rate is set
+        mcpwm_init(MCPWM_UNIT_0, m.timer, &cfg);
+        pulse_off(m);
+    }
+}
+
+static int32_t clamp_rate(int32_t rate)
+{
+    if (rate > STEPPER_MAX_RATE)
+        return STEPPER_MAX_RATE;
+    if (rate < -STEPPER_MAX_RATE)
+        return -STEPPER_MAX_RATE;
+    return rate;
+}
+
+void stepper_set_rates(int32_t rate1, int32_t rate2)
+{
+    int32_t rates[STEPPER_COUNT] = {rate1, rate2};
+    uint32_t enable = 0;
+
+    for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+    {
+        motors[i].release = false;
+        motors[i].target = clamp_rate(rates[i]);
+        enable |= gpio_bit(motors[i].en_pin);
+    }
+    gpio_fast_write(0, enable);
+}
+
+void stepper_stop()
+{
+    for (stepper &m : motors)
+    {
+        m.release = true;
+        m.exact = false;
+        m.target = 0;
+    }
+}
+
+int32_t stepper_rate(uint8_t motor)
+{
+    return motors[motor].target;
+}
+
+int32_t stepper_output_rate(uint8_t motor)
+{
+    const stepper &m = motors[motor];
+    return m.out_dir * (int32_t)m.out_rate;
+}
+
+int32_t stepper_steps(uint8_t motor)
+{
+    return motors[motor].steps;
+}
+
+void stepper_set_ramp(uint32_t new_accel, uint32_t new_jerk)
+{
+    accel = new_accel;
+    jerk = new_jerk;
+    limits = ramp_make_limits(accel, jerk, STEPPER_TICK_HZ);
+}
+
+uint32_t stepper_brake_steps(uint32_t from, uint32_t to)
+{
+    if (from <= to)
+        return 0;
+
+    // constant deceleration, plus the distance covered while the jerk limit
+    // builds it up and one tick of reaction, then a quarter for margin
+    uint64_t steps = ((uint64_t)from * from - (uint64_t)to * to) / (2 * accel);
+    if (jerk)
+        steps += (uint64_t)from * accel / jerk;
+    steps += from / STEPPER_TICK_HZ + 1;
+    return steps + steps / 4;
+}
+
+void stepper_stop_at(uint8_t motor, int32_t goal)
+{
+    stepper &m = motors[motor];
+    portENTER_CRITICAL(&lock);
+    m.goal = goal;
+    m.armed = false;
+    m.at_goal = false;
+    m.exact = true;
+    portEXIT_CRITICAL(&lock);
+}
+
+void stepper_cancel_goal(uint8_t motor)
+{
+    stepper &m = motors[motor];
+    portENTER_CRITICAL(&lock);
+    if (m.armed)
+        pcnt_event_disable(m.pcnt, PCNT_EVT_THRES_0);
+    m.exact = false;
+    m.armed = false;
+    portEXIT_CRITICAL(&lock);
+}
+
+bool stepper_at_goal(uint8_t motor)
+{
+    return motors[motor].at_goal;
+}
@@ -0,0 +1,118 @@
+#include <Arduino.h>
+#include <esp_system.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "control.h"
+#include "gun.h"
+#include "idle.h"
+#include "link.h"
+#include "profiler.h"
+#include "protocol.h"
+#include "recorder.h"
+#include "shared_state.h"
+#include "stepper.h"
+#include "telemetry.h"
+
+static TaskHandle_t task;
+static TaskHandle_t comms_task;
+static TaskHandle_t sensor_task;
+static volatile uint8_t rate_hz = TELEMETRY_HZ;
+static volatile uint8_t mode = TELEMETRY_MODE_HOST;
+static std::atomic<uint32_t> loop_max[TELEMETRY_LOOPS];
+
+static uint16_t stack_free(TaskHandle_t t)
+{
+    // the ESP-IDF watermark is in bytes
+    return t ? uxTaskGetStackHighWaterMark(t) : 0;
+}
+
+uint8_t telemetry_encode(uint8_t * out)
+{
+    PROFILE(PROF_TELEMETRY);
+    sensor_frame frame = {};
+    sensor_state.try_read(frame);
+
+    uint8_t * p = out;
+    *p++ = OP_TELEMETRY;
+    p = proto_put_u32(p, millis());
+    // the frame always has TELEMETRY_SENSORS slots, unfitted ones read 0
+    for (uint8_t i = 0; i < TELEMETRY_SENSORS; i++)
+        p = proto_put_u16(p, i < SENSOR_COUNT ? frame.ranges[i].mm : 0);
+    for (uint8_t i = 0; i < TELEMETRY_SENSORS; i++)
+        *p++ = i < SENSOR_COUNT ? frame.ranges[i].confidence : 0;
+    *p++ = idle_active() ? TELEMETRY_MODE_IDLE : mode;
+    *p++ = frame.plan.motion;
+    for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+        p = proto_put_u16(p, (uint16_t)stepper_output_rate(i));
+    *p++ = gun_get_state();
+    for (std::atomic<uint32_t> &t : loop_max)
+    {
+        uint32_t us = t.exchange(0);
+        p = proto_put_u16(p, us > 0xFFFF ? 0xFFFF : us);
+    }
+    const control_stats &control = control_get_stats();
+    p = proto_put_u16(p, control.wcet_us > 0xFFFF ? 0xFFFF : control.wcet_us);
+    p = proto_put_u32(p, control.overruns);
+    p = proto_put_u32(p, esp_get_free_heap_size());
+    TaskHandle_t watched[] = {control_handle(), comms_task, sensor_task,
+                              link_rx_handle(), link_tx_handle(), task};
+    for (TaskHandle_t t : watched)
+        p = proto_put_u16(p, stack_free(t));
+    return p - out;
+}
+
+static void telemetry_task(void * parameter)
+{
+    TickType_t last = xTaskGetTickCount();
+
+    while (1)
+    {
+        uint8_t hz = rate_hz;
+        if (hz == 0)
+        {
+            // sleeps until telemetry_set_rate turns the stream back on
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            last = xTaskGetTickCount();
+            continue;
+        }
+
+        TickType_t period = pdMS_TO_TICKS(1000 / hz);
+        vTaskDelayUntil(&last, period ? period : 1);
+
+        uint8_t payload[PROTO_MAX_PAYLOAD];
+        link_send(payload, telemetry_encode(payload));
+    }
+}
+
+void telemetry_init(TaskHandle_t comms, TaskHandle_t sensor)
+{
+    comms_task = comms;
+    sensor_task = sensor;
+    xTaskCreatePinnedToCore(telemetry_task, "Telemetry", TELEMETRY_STACK, NULL, TELEMETRY_PRIORITY, &task, 0);
+}
+
+void telemetry_set_rate(uint8_t hz)
+{
+    if (hz > TELEMETRY_MAX_HZ)
+        hz = TELEMETRY_MAX_HZ;
+    rate_hz = hz;
+    if (task)
+        xTaskNotifyGive(task);
+}
+
+void telemetry_loop_time(telemetry_loop loop, uint32_t us)
+{
+    std::atomic<uint32_t> &t = loop_max[loop];
+    uint32_t seen = t.load(std::memory_order_relaxed);
+    while (us > seen && !t.compare_exchange_weak(seen, us))
+        ;
+}
+
+void telemetry_set_mode(telemetry_mode m)
+{
+    if (m != mode)
+        rec_log(REC_MODE, m, 0, stepper_rate(0), stepper_rate(1));
+    mode = m;
+}
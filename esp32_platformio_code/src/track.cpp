@@ -0,0 +1,108 @@
+#include <Arduino.h>
+
+#include "config.h"
+#include "drive.h"
+#include "seqlock.h"
+#include "stepper.h"
+#include "track.h"
+
+struct track_target
+{
+    int32_t bearing;    // centidegrees
+    int32_t rate;       // centidegrees/s, against the ground
+    int32_t forward;
+    uint32_t t_us;
+};
+
+static seqlock<track_target> target;
+static volatile bool active = false;
+
+// as in segments.cpp, a track_stop cannot land between the control loop's
+// check of active and its rate writes
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+// only the control loop touches these
+static uint32_t applied = 0;        // version of target being followed
+static bool following = false;
+static track_target current;
+static int32_t steps_at[STEPPER_COUNT];
+
+// chassis_turn returns the spin rate of the wheel output in centidegrees/s
+static int32_t chassis_turn()
+{
+    return drive_turn_centideg((stepper_output_rate(0) - stepper_output_rate(1)) / 2);
+}
+
+void track_set(int16_t bearing, int16_t rate, int16_t forward)
+{
+    // the camera sees a still target drift against the chassis' own turn
+    target.write({bearing, rate + chassis_turn(), forward, (uint32_t)micros()});
+    active = true;
+}
+
+void track_stop()
+{
+    portENTER_CRITICAL(&lock);
+    active = false;
+    portEXIT_CRITICAL(&lock);
+}
+
+// steer runs one tick of tracking with the lock held
+static void steer()
+{
+    if (!active)
+    {
+        following = false;
+        return;
+    }
+
+    track_target t;
+    uint32_t version = target.version();
+    if (version != applied && target.try_read(t))
+    {
+        applied = version;
+        current = t;
+        following = true;
+        for (uint8_t i = 0; i < STEPPER_COUNT; i++)
+            steps_at[i] = stepper_steps(i);
+    }
+    if (!following)
+        return;
+
+    uint32_t age_us = micros() - current.t_us;
+    if (age_us > TRACK_STALE_MS * 1000)
+    {
+        following = false;
+        stepper_stop();
+        return;
+    }
+
+    // past the horizon the target is held where it was last predicted
+    int32_t rate = current.rate;
+    if (age_us > TRACK_EXTRAPOLATE_MS * 1000)
+    {
+        age_us = TRACK_EXTRAPOLATE_MS * 1000;
+        rate = 0;
+    }
+
+    int32_t turned = drive_turn_centideg(((stepper_steps(0) - steps_at[0]) - (stepper_steps(1) - steps_at[1])) / 2);
+    int32_t bearing = current.bearing + (int64_t)current.rate * age_us / 1000000 - turned;
+
+    // feeds the target's own motion forward and closes on what is left
+    int32_t turn = drive_turn_steps(rate + bearing * TRACK_GAIN / 256);
+    if (turn > TRACK_MAX_TURN)
+        turn = TRACK_MAX_TURN;
+    if (turn < -TRACK_MAX_TURN)
+        turn = -TRACK_MAX_TURN;
+
+    int32_t rate1, rate2;
+    drive_mix(current.forward, turn, STEPPER_MAX_RATE, rate1, rate2);
+    stepper_set_rates(rate1, rate2);
+}
+
+void track_run()
+{
+    portENTER_CRITICAL(&lock);
+    steer();
+    portEXIT_CRITICAL(&lock);
+}
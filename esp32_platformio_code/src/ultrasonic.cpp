@@ -0,0 +1,181 @@
+#include <Arduino.h>
+#include <driver/mcpwm.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "gpio_fast.h"
+#include "profiler.h"
+#include "spsc_ring.h"
+#include "ultrasonic.h"
+
+
+// Echo pulses are timed by the MCPWM capture units: unit 0 channels 0-2 and
+// unit 1 channels 0-1. The capture timer latches the APB clock on each edge
+// in hardware, so ISR latency no longer shows up in the measured width.
+#define CAPTURE_TICKS_PER_US 80
+
+struct capture_channel
+{
+    mcpwm_unit_t unit;
+    mcpwm_capture_channel_id_t channel;
+    mcpwm_io_signals_t signal;
+};
+
+static constexpr capture_channel captures[] = {
+    {MCPWM_UNIT_0, MCPWM_SELECT_CAP0, MCPWM_CAP_0},
+    {MCPWM_UNIT_0, MCPWM_SELECT_CAP1, MCPWM_CAP_1},
+    {MCPWM_UNIT_0, MCPWM_SELECT_CAP2, MCPWM_CAP_2},
+    {MCPWM_UNIT_1, MCPWM_SELECT_CAP0, MCPWM_CAP_0},
+    {MCPWM_UNIT_1, MCPWM_SELECT_CAP1, MCPWM_CAP_1},
+};
+
+static TaskHandle_t scan_task;
+static uint8_t slot = 0;
+
+// shared with the capture ISR while a slot is open
+static std::atomic<uint32_t> armed{0};      // sensors of the open slot still due
+static std::atomic<uint32_t> rising{0};     // sensors whose echo has started
+static uint32_t rise_ticks[SENSOR_COUNT];   // ISR only
+static spsc_ring<uint32_t, 4> echoes[SENSOR_COUNT];    // pulse widths, ticks
+
+static echo_sample samples[SENSOR_COUNT];
+
+static_assert(SENSOR_COUNT <= sizeof(captures) / sizeof(captures[0]),
+              "more sonars than capture channels");
+
+// ultra_trig fires every sensor in mask with one shared 10 us pulse, all
+// edges in the same register write
+void ultra_trig(uint8_t mask)
+{
+    PROFILE(PROF_ULTRA_TRIG);
+    uint32_t pins = 0;
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        if (mask & (1 << i))
+            pins |= gpio_bit(robot.sensors[i].trig);
+    }
+    gpio_fast_write(pins, 0);
+    delayMicroseconds(10);
+    gpio_fast_write(0, pins);
+}
+
+// echo_capture runs on every captured edge, edges from sensors outside the
+// open slot are ignored. Only the last echo of a slot wakes the scan task.
+static bool IRAM_ATTR echo_capture(mcpwm_unit_t unit, mcpwm_capture_channel_id_t channel,
+                                   const cap_event_data_t * edata, void * arg)
+{
+    PROFILE(PROF_ECHO_ISR);
+    uint8_t index = (uint8_t)(uintptr_t)arg;
+    uint32_t bit = 1 << index;
+
+    if (!(armed.load(std::memory_order_relaxed) & bit))
+        return false;
+
+    if (edata->cap_edge == MCPWM_POS_EDGE)
+    {
+        rise_ticks[index] = edata->cap_value;
+        rising.fetch_or(bit);
+        return false;
+    }
+
+    if (!(rising.load(std::memory_order_relaxed) & bit))
+        return false;
+
+    echoes[index].push(edata->cap_value - rise_ticks[index]);
+    if (armed.fetch_and(~bit) != bit)
+        return false;
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(scan_task, &woken);
+    return woken == pdTRUE;
+}
+
+char init_ultrasonic()
+{
+    scan_task = xTaskGetCurrentTaskHandle();
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        const capture_channel &c = captures[i];
+        mcpwm_gpio_init(c.unit, c.signal, robot.sensors[i].echo);
+
+        mcpwm_capture_config_t conf = {};
+        conf.cap_edge = MCPWM_BOTH_EDGE;
+        conf.cap_prescale = 1;
+        conf.capture_cb = echo_capture;
+        conf.user_data = (void *)(uintptr_t)i;
+        mcpwm_capture_enable_channel(c.unit, c.channel, &conf);
+    }
+
+    for (const sonar &s : robot.sensors)
+    {
+        pinMode(s.trig, OUTPUT);
+        digitalWrite(s.trig, LOW);
+    }
+
+    return 0;
+}
+
+uint8_t ultrasonic_scan()
+{
+    uint8_t mask = robot.slots[slot];
+    uint32_t window_us = 0;
+
+    slot = (slot + 1) % robot.slot_count;
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        if ((mask & (1 << i)) && robot.sensors[i].max_echo_us > window_us)
+            window_us = robot.sensors[i].max_echo_us;
+    }
+
+    ulTaskNotifyTake(pdTRUE, 0);
+    rising.store(0);
+    armed.store(mask);
+    uint32_t t_us = micros();
+    ultra_trig(mask);
+
+    // returns early once the last echo of the slot has fallen
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(window_us / 1000 + 1));
+    armed.store(0);
+    uint32_t started = rising.load();
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        uint8_t bit = 1 << i;
+        if (!(mask & bit))
+            continue;
+
+        uint32_t ticks;
+        bool echoed = false;
+        while (echoes[i].pop(ticks))
+            echoed = true;
+
+        echo_sample &s = samples[i];
+        s.t_us = t_us;
+        if (echoed && ticks / CAPTURE_TICKS_PER_US <= robot.sensors[i].max_echo_us)
+        {
+            s.echo_us = ticks / CAPTURE_TICKS_PER_US;
+            s.status = ECHO_OK;
+        } else
+        {
+            s.status = started & bit ? ECHO_OUT_OF_RANGE : ECHO_MISSING;
+        }
+    }
+
+    // let the bursts die down before the next slot fires
+    vTaskDelay(pdMS_TO_TICKS(SENSOR_GUARD_MS));
+    return mask;
+}
+
+echo_sample ultrasonic_sample(uint8_t sensor)
+{
+    return samples[sensor];
+}
+
+bool ultrasonic_fresh(const echo_sample &s, uint32_t max_age_us)
+{
+    return s.status == ECHO_OK && micros() - s.t_us <= max_age_us;
+}
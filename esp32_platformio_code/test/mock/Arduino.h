@@ -0,0 +1,58 @@
+#pragma once
+
+// Mock of the parts of the Arduino core the firmware uses, for the native
+// environment. Pins only remember their last mode and level, time is the
+// host's monotonic clock since start, Serial is a pair of byte queues.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define IRAM_ATTR
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+unsigned long micros();
+unsigned long millis();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+uint32_t getCpuFrequencyMhz();
+
+class HardwareSerial
+{
+public:
+    void begin(unsigned long baud);
+    void end();
+    int available();
+    int read();
+    int peek();
+    size_t write(uint8_t byte);
+    size_t write(const uint8_t * data, size_t len);
+    size_t print(const char * text);
+    size_t print(char c);
+    size_t print(long n);
+    size_t println(const char * text = "");
+    size_t println(long n);
+    void flush();
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+// only the handle types, for headers that pass queues around; nothing in
+// the native build creates one
+typedef struct mock_queue * QueueHandle_t;
+typedef struct mock_queue * QueueSetHandle_t;
@@ -0,0 +1,125 @@
+#include "Arduino.h"
+#include "grid.h"
+#include "gun.h"
+#include "idle.h"
+#include "link.h"
+#include "mock_firmware.h"
+#include "odometry.h"
+#include "profiler.h"
+#include "protocol.h"
+#include "recorder.h"
+#include "segments.h"
+#include "stepper.h"
+#include "telemetry.h"
+#include "track.h"
+
+mock_calls mock_firmware;
+
+static uint8_t tx_seq;
+
+void mock_firmware_reset()
+{
+    mock_firmware = {};
+    tx_seq = 0;
+}
+
+// stepper, segments, track
+
+void stepper_set_rates(int32_t rate1, int32_t rate2)
+{
+    mock_firmware.set_rates++;
+    mock_firmware.rates[0] = rate1;
+    mock_firmware.rates[1] = rate2;
+}
+
+void stepper_stop()
+{
+    mock_firmware.stops++;
+    mock_firmware.rates[0] = 0;
+    mock_firmware.rates[1] = 0;
+}
+
+bool segments_push(segment)
+{
+    mock_firmware.segments++;
+    return true;
+}
+
+void segments_clear()
+{
+    mock_firmware.segment_clears++;
+}
+
+void track_set(int16_t, int16_t, int16_t)
+{
+    mock_firmware.track_sets++;
+}
+
+void track_stop()
+{
+    mock_firmware.track_stops++;
+}
+
+// telemetry, gun, odometry, grid, idle
+
+void telemetry_set_mode(telemetry_mode mode)
+{
+    mock_firmware.mode = mode;
+}
+
+void telemetry_set_rate(uint8_t)
+{
+}
+
+bool gun_fire(uint8_t shots)
+{
+    mock_firmware.shots += shots;
+    return true;
+}
+
+void odometry_set(float, float, float)
+{
+}
+
+void grid_sync(uint8_t)
+{
+}
+
+void idle_wake()
+{
+}
+
+// profiler, recorder
+
+void prof_record(uint8_t, uint32_t, uint32_t)
+{
+}
+
+void prof_dump(uint8_t)
+{
+}
+
+void rec_log(uint8_t, uint8_t, uint16_t, int32_t, int32_t)
+{
+    mock_firmware.records++;
+}
+
+void rec_dump(uint16_t)
+{
+}
+
+// link
+
+bool link_send(const uint8_t * payload, uint8_t len)
+{
+    uint8_t frame[PROTO_MAX_FRAME];
+    size_t size = proto_encode(frame, tx_seq++, payload, len);
+    Serial.write(frame, size);
+    mock_firmware.sent++;
+    return true;
+}
+
+void link_applied(const link_rx &)
+{
+    mock_firmware.applied++;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "telemetry.h"
+
+// Test side of the mocked firmware modules, for the sources the native build
+// takes from src/ (the dispatcher) without the hardware bound ones they
+// call. Each mock only counts its calls and keeps the last arguments;
+// link_send frames the payload onto the mock Serial, so mock_serial_take
+// reads back what the firmware would have sent the host.
+
+struct mock_calls
+{
+    uint32_t set_rates;     // stepper_set_rates
+    int32_t rates[2];
+    uint32_t stops;         // stepper_stop
+    uint32_t segments;      // segments_push
+    uint32_t segment_clears;
+    uint32_t track_sets;
+    uint32_t track_stops;
+    telemetry_mode mode;    // last telemetry_set_mode
+    uint32_t shots;         // gun_fire, shots asked for
+    uint32_t records;       // rec_log
+    uint32_t sent;          // frames link_send put on the mock Serial
+    uint32_t applied;       // link_applied
+};
+
+extern mock_calls mock_firmware;
+
+void mock_firmware_reset();
@@ -0,0 +1,325 @@
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+
+#include "Arduino.h"
+#include "mock_hal.h"
+#include "xtensa/core-macros.h"
+
+static const auto start = std::chrono::steady_clock::now();
+
+static std::mutex lock;     // pins and serial queues
+static mock_pin pins[MOCK_PINS];
+static std::deque<uint8_t> serial_in;
+static std::deque<uint8_t> serial_out;
+
+static std::recursive_mutex critical;
+
+struct mock_task
+{
+    TaskFunction_t fn;
+    void * arg;
+    std::mutex lock;
+    std::condition_variable wake;
+    uint32_t notified;
+};
+
+static thread_local mock_task * current = nullptr;
+
+// pins
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    std::lock_guard<std::mutex> g(lock);
+    if (pin < MOCK_PINS)
+        pins[pin].mode = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+    std::lock_guard<std::mutex> g(lock);
+    if (pin < MOCK_PINS)
+    {
+        pins[pin].level = level ? HIGH : LOW;
+        pins[pin].writes++;
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    std::lock_guard<std::mutex> g(lock);
+    return pin < MOCK_PINS ? pins[pin].level : LOW;
+}
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long)
+{
+    std::lock_guard<std::mutex> g(lock);
+    if (pin < MOCK_PINS)
+        pins[pin].tone = frequency;
+}
+
+void noTone(uint8_t pin)
+{
+    std::lock_guard<std::mutex> g(lock);
+    if (pin < MOCK_PINS)
+        pins[pin].tone = 0;
+}
+
+void attachInterrupt(uint8_t, void (*)(void), int)
+{
+}
+
+void detachInterrupt(uint8_t)
+{
+}
+
+mock_pin mock_pin_state(uint8_t pin)
+{
+    std::lock_guard<std::mutex> g(lock);
+    return pin < MOCK_PINS ? pins[pin] : mock_pin{};
+}
+
+// time
+
+unsigned long micros()
+{
+    auto t = std::chrono::steady_clock::now() - start;
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(t).count();
+}
+
+unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+uint32_t getCpuFrequencyMhz()
+{
+    return 240;
+}
+
+uint32_t mock_ccount()
+{
+    auto t = std::chrono::steady_clock::now() - start;
+    return (uint32_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(t).count() * 240 / 1000);
+}
+
+// serial
+
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long)
+{
+}
+
+void HardwareSerial::end()
+{
+}
+
+int HardwareSerial::available()
+{
+    std::lock_guard<std::mutex> g(lock);
+    return serial_in.size();
+}
+
+int HardwareSerial::read()
+{
+    std::lock_guard<std::mutex> g(lock);
+    if (serial_in.empty())
+        return -1;
+    uint8_t byte = serial_in.front();
+    serial_in.pop_front();
+    return byte;
+}
+
+int HardwareSerial::peek()
+{
+    std::lock_guard<std::mutex> g(lock);
+    return serial_in.empty() ? -1 : serial_in.front();
+}
+
+size_t HardwareSerial::write(uint8_t byte)
+{
+    std::lock_guard<std::mutex> g(lock);
+    serial_out.push_back(byte);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t * data, size_t len)
+{
+    std::lock_guard<std::mutex> g(lock);
+    serial_out.insert(serial_out.end(), data, data + len);
+    return len;
+}
+
+size_t HardwareSerial::print(const char * text)
+{
+    return write((const uint8_t *)text, strlen(text));
+}
+
+size_t HardwareSerial::print(char c)
+{
+    return write((uint8_t)c);
+}
+
+size_t HardwareSerial::print(long n)
+{
+    char text[24];
+    snprintf(text, sizeof(text), "%ld", n);
+    return print(text);
+}
+
+size_t HardwareSerial::println(const char * text)
+{
+    return print(text) + print("\r\n");
+}
+
+size_t HardwareSerial::println(long n)
+{
+    return print(n) + print("\r\n");
+}
+
+void HardwareSerial::flush()
+{
+}
+
+void mock_serial_feed(const uint8_t * data, size_t len)
+{
+    std::lock_guard<std::mutex> g(lock);
+    serial_in.insert(serial_in.end(), data, data + len);
+}
+
+size_t mock_serial_take(uint8_t * data, size_t len)
+{
+    std::lock_guard<std::mutex> g(lock);
+    size_t n = 0;
+    while (n < len && !serial_out.empty())
+    {
+        data[n++] = serial_out.front();
+        serial_out.pop_front();
+    }
+    return n;
+}
+
+void mock_reset()
+{
+    std::lock_guard<std::mutex> g(lock);
+    for (mock_pin &p : pins)
+        p = {};
+    serial_in.clear();
+    serial_out.clear();
+}
+
+// FreeRTOS
+
+void portENTER_CRITICAL(portMUX_TYPE *)
+{
+    critical.lock();
+}
+
+void portEXIT_CRITICAL(portMUX_TYPE *)
+{
+    critical.unlock();
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *, uint32_t, void * arg, UBaseType_t,
+                                   TaskHandle_t * handle, BaseType_t)
+{
+    mock_task * task = new mock_task();
+    task->fn = fn;
+    task->arg = arg;
+    task->notified = 0;
+    if (handle)
+        *handle = task;
+
+    std::thread([task] {
+        current = task;
+        task->fn(task->arg);
+    }).detach();
+    return pdPASS;
+}
+
+// a task's thread cannot be killed from outside, only vTaskDelete(NULL)
+// ends one, by parking it for good
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task && task != current)
+        return;
+    while (1)
+        std::this_thread::sleep_for(std::chrono::hours(1));
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    delay(ticks);
+}
+
+void vTaskDelayUntil(TickType_t * previous, TickType_t period)
+{
+    *previous += period;
+    int32_t wait = (int32_t)(*previous - xTaskGetTickCount());
+    if (wait > 0)
+        delay(wait);
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return current;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t)
+{
+    return 0;
+}
+
+BaseType_t xPortGetCoreID()
+{
+    return 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    if (!current)
+        return 0;
+
+    std::unique_lock<std::mutex> g(current->lock);
+    current->wake.wait_for(g, std::chrono::milliseconds(ticks), [] { return current->notified != 0; });
+    uint32_t count = current->notified;
+    if (count)
+        current->notified = clear ? 0 : count - 1;
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> g(task->lock);
+        task->notified++;
+    }
+    task->wake.notify_one();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t * woken)
+{
+    xTaskNotifyGive(task);
+    if (woken)
+        *woken = pdTRUE;
+}
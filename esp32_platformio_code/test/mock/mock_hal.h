@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Test side of the mock HAL, for inspecting and driving what the firmware
+// sees through Arduino.h.
+
+#define MOCK_PINS 40
+
+struct mock_pin
+{
+    uint8_t mode;
+    uint8_t level;
+    uint32_t writes;    // digitalWrite calls so far
+    unsigned int tone;  // frequency of a running tone, 0 = none
+};
+
+mock_pin mock_pin_state(uint8_t pin);
+
+// mock_serial_feed queues bytes for Serial.read
+void mock_serial_feed(const uint8_t * data, size_t len);
+
+// mock_serial_take moves up to len bytes the firmware wrote out to data and
+// returns how many there were
+size_t mock_serial_take(uint8_t * data, size_t len);
+
+void mock_reset();
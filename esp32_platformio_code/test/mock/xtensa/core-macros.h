@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+// the CCOUNT register, counted from the host clock at the mocked CPU
+// frequency so cycle budgets convert the same way
+uint32_t mock_ccount();
+
+#define XTHAL_GET_CCOUNT() mock_ccount()
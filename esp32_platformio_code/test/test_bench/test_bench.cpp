@@ -0,0 +1,243 @@
+// Micro-benchmarks of the hardware independent hot paths, run on the build
+// host by the native environment: pio test -e native -v prints the cost of
+// one iteration of each. The budgets are far above what any recent host
+// needs, they only catch a change that makes a path several times slower.
+
+#include <chrono>
+#include <stdio.h>
+#include <unity.h>
+
+#include "config.h"
+#include "dispatch.h"
+#include "gun.h"
+#include "link.h"
+#include "mock_firmware.h"
+#include "mock_hal.h"
+#include "planner.h"
+#include "protocol.h"
+#include "range_filter.h"
+
+#define BENCH_ITERATIONS 200000
+
+// ns per iteration
+#define BENCH_PARSER_BUDGET 2000    // one frame of four commands, byte by byte
+#define BENCH_FILTER_BUDGET 300     // one sample through one sensor's filter
+#define BENCH_PLANNER_BUDGET 1000   // one planner update
+#define BENCH_DISPATCH_BUDGET 5000  // one batch of three frames through handle_batch
+
+static volatile uint32_t sink;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+template <typename F>
+static double bench(const char * name, F &&fn)
+{
+    // one pass to warm caches and branch predictors
+    for (uint32_t i = 0; i < BENCH_ITERATIONS / 10; i++)
+        fn(i);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++)
+        fn(i);
+    std::chrono::duration<double, std::nano> t = std::chrono::steady_clock::now() - start;
+
+    double ns = t.count() / BENCH_ITERATIONS;
+    char msg[80];
+    snprintf(msg, sizeof(msg), "%s: %.1f ns/iteration", name, ns);
+    TEST_MESSAGE(msg);
+    return ns;
+}
+
+static void test_parser()
+{
+    // the frame the host streams while tracking: state, fire, heartbeat, ping
+    uint8_t payload[PROTO_MAX_PAYLOAD];
+    uint8_t len = 0;
+    payload[len++] = OP_DRIVE;
+    proto_put_u16(proto_put_u16(&payload[len], 0), 400);
+    len += 4;
+    payload[len++] = OP_FIRE;
+    payload[len++] = 1;
+    payload[len++] = 0x01;
+    payload[len++] = OP_HEARTBEAT;
+    payload[len++] = OP_PING;
+    proto_put_u32(&payload[len], 0x12345678);
+    len += 4;
+
+    uint8_t frame[PROTO_MAX_FRAME];
+    size_t size = proto_encode(frame, 0, payload, len);
+
+    proto_parser p = {};
+    proto_parser_reset(p);
+    uint32_t commands = 0;
+
+    double ns = bench("parser", [&](uint32_t i) {
+        frame[2] = i;   // a new seq each time, the CRC no longer matches
+        for (size_t b = 0; b < size - PROTO_CRC_LEN; b++)
+            proto_feed(p, frame[b]);
+        uint16_t crc = proto_crc16(0xFFFF, &frame[1], size - 1 - PROTO_CRC_LEN);
+        proto_feed(p, crc);
+        if (!proto_feed(p, crc >> 8))
+            return;
+
+        uint8_t offset = 0;
+        proto_cmd cmd;
+        while (proto_next_cmd(p.frame, offset, cmd))
+            commands++;
+    });
+
+    TEST_ASSERT_EQUAL_UINT32((BENCH_ITERATIONS + BENCH_ITERATIONS / 10) * 4, commands);
+    TEST_ASSERT_EQUAL_UINT32(0, p.crc_errors);
+    TEST_ASSERT_LESS_THAN_UINT32(BENCH_PARSER_BUDGET, (uint32_t)ns);
+}
+
+static void test_filter()
+{
+    range_filter_config cfg = {RANGE_MEDIAN, RANGE_EMA_ALPHA, RANGE_OUTLIER_MM,
+                               RANGE_OUTLIER_CONFIRM, RANGE_FAR_MM};
+    range_filter f;
+    range_filter_init(f, cfg);
+
+    // a wall at about a metre with jitter, a spike every 16th sample and a
+    // dropped echo every 64th
+    double ns = bench("range filter", [&](uint32_t i) {
+        uint32_t echo = 5800 + (i * 37 % 120);
+        uint8_t status = ECHO_OK;
+        if (i % 16 == 0)
+            echo = 900;
+        if (i % 64 == 0)
+            status = ECHO_MISSING;
+        sink = range_filter_update(f, cfg, status, echo).mm;
+    });
+
+    TEST_ASSERT_UINT16_WITHIN(50, 1000, f.out.mm);
+    TEST_ASSERT_LESS_THAN_UINT32(BENCH_FILTER_BUDGET, (uint32_t)ns);
+}
+
+static void test_planner()
+{
+    planner_state s;
+    planner_config cfg = {{}, PLAN_STOP_MM, PLAN_SLOW_MM, PLAN_CLEAR_MM,
+                          PLAN_FRONT_DEG, PLAN_BEARING_COST, RANGE_MIN_CONFIDENCE,
+                          PLAN_MAX_FORWARD, PLAN_MAX_TURN, PLAN_TURN_GAIN};
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+        cfg.bearing_deg[i] = robot.sensors[i].bearing_deg;
+    planner_init(s);
+
+    // scattered ranges, half of them weak, so every branch of the planner runs
+    range_reading ranges[SENSOR_COUNT];
+    double ns = bench("planner", [&](uint32_t i) {
+        for (uint8_t k = 0; k < SENSOR_COUNT; k++)
+            ranges[k] = {(uint16_t)((i * (k + 3) * 97) % 3000), (uint8_t)(i % 2 ? 255 : 80)};
+        sink = planner_update(s, cfg, ranges).turn;
+    });
+
+    TEST_ASSERT_LESS_THAN_UINT32(BENCH_PLANNER_BUDGET, (uint32_t)ns);
+}
+
+static void test_dispatch()
+{
+    // three frames of drive and heartbeat as they queue up behind a slow
+    // comms task, the newest firing while tracking and pinging as well
+    link_rx batch[3] = {};
+    for (uint8_t k = 0; k < 3; k++)
+    {
+        uint8_t payload[PROTO_MAX_PAYLOAD];
+        uint8_t len = 0;
+        payload[len++] = OP_DRIVE;
+        proto_put_u16(proto_put_u16(&payload[len], 400), 0);
+        len += 4;
+        payload[len++] = OP_HEARTBEAT;
+        if (k == 2)
+        {
+            payload[len++] = OP_FIRE;
+            payload[len++] = 1;
+            payload[len++] = GUN_TRACKING;
+            payload[len++] = OP_PING;
+            proto_put_u32(&payload[len], 0x12345678);
+            len += 4;
+        }
+
+        uint8_t frame[PROTO_MAX_FRAME];
+        size_t size = proto_encode(frame, k, payload, len);
+        proto_parser p = {};
+        proto_parser_reset(p);
+        for (size_t b = 0; b < size; b++)
+            proto_feed(p, frame[b]);
+        TEST_ASSERT_EQUAL_UINT32(1, p.frames);
+        batch[k].frame = p.frame;
+    }
+
+    mock_reset();
+    mock_firmware_reset();
+    dispatch_forget_state();
+    uint8_t out[64];
+    uint32_t out_bytes = 0;
+
+    double ns = bench("dispatch", [&](uint32_t i) {
+        // a new turn in every frame, so each batch changes the state
+        for (uint8_t k = 0; k < 3; k++)
+        {
+            batch[k].frame.seq = i * 3 + k;
+            proto_put_u16(&batch[k].frame.payload[3], (i * 3 + k) % 800);
+        }
+        handle_batch(batch, 3);
+        // the pong and the ack
+        out_bytes += mock_serial_take(out, sizeof(out));
+    });
+
+    uint32_t batches = BENCH_ITERATIONS + BENCH_ITERATIONS / 10;
+    // every drive but the newest of a batch is coalesced away
+    TEST_ASSERT_EQUAL_UINT32(batches, mock_firmware.set_rates);
+    TEST_ASSERT_EQUAL_UINT32(batches * 3, mock_firmware.applied);
+    TEST_ASSERT_EQUAL_UINT32(batches * 2, mock_firmware.sent);
+    TEST_ASSERT_EQUAL_UINT32(batches, mock_firmware.shots);
+    TEST_ASSERT_EQUAL_UINT32(0, mock_firmware.stops);
+    TEST_ASSERT_EQUAL(TELEMETRY_MODE_HOST, mock_firmware.mode);
+
+    uint8_t frame[PROTO_MAX_FRAME];
+    uint8_t pong[1 + 4] = {OP_PONG};
+    uint8_t ack[1 + 1] = {OP_ACK};
+    size_t replies = proto_encode(frame, 0, pong, sizeof(pong)) + proto_encode(frame, 0, ack, sizeof(ack));
+    TEST_ASSERT_EQUAL_UINT32(batches * replies, out_bytes);
+
+    // the ack names the newest frame of the batch
+    handle_batch(batch, 3);
+    uint8_t reply[2 * PROTO_MAX_FRAME];
+    size_t n = mock_serial_take(reply, sizeof(reply));
+    proto_parser p = {};
+    proto_parser_reset(p);
+    uint32_t acked = 0;
+    for (size_t b = 0; b < n; b++)
+    {
+        if (!proto_feed(p, reply[b]))
+            continue;
+        uint8_t offset = 0;
+        proto_cmd cmd;
+        while (proto_next_cmd(p.frame, offset, cmd))
+            if (cmd.opcode == OP_ACK)
+            {
+                TEST_ASSERT_EQUAL_UINT8(batch[2].frame.seq, cmd.params[0]);
+                acked++;
+            }
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, acked);
+
+    TEST_ASSERT_LESS_THAN_UINT32(BENCH_DISPATCH_BUDGET, (uint32_t)ns);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_parser);
+    RUN_TEST(test_filter);
+    RUN_TEST(test_planner);
+    RUN_TEST(test_dispatch);
+    return UNITY_END();
+}
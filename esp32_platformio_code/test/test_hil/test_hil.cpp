@@ -0,0 +1,312 @@
+// Hardware-in-the-loop latency and throughput suite, runs on the robot with
+// the full firmware: pio test -e hil. Put the chassis on a stand, the
+// wheels turn. Results are printed as Unity messages, so two builds can be
+// compared run against run.
+//
+// The hil environment moves the link to UART1, Unity keeps UART0. Test
+// frames go out on UART2, whose TX is routed onto the link's RX pad inside
+// the chip, or with -DHIL_LOOPBACK_JIG out of HIL_JIG_TX_PIN and through a
+// wire to LINK_RX_PIN, so the pads and the wire are part of the path.
+
+#include <Arduino.h>
+#include <algorithm>
+#include <driver/uart.h>
+#include <soc/gpio_periph.h>
+#include <unity.h>
+
+#include "config.h"
+#include "gpio_fast.h"
+#include "gun.h"
+#include "link.h"
+#include "profiler.h"
+#include "protocol.h"
+#include "shared_state.h"
+#include "stepper.h"
+
+#define HIL_UART UART_NUM_2
+#define HIL_JIG_TX_PIN 14
+#define HIL_SAMPLES 100
+#define HIL_WINDOW_MS 2000      // sensor and throughput measurements
+#define HIL_TEST_RATE 300       // steps/s used for direction changes
+
+#ifdef HIL_LOOPBACK_JIG
+#define HIL_TX_PIN HIL_JIG_TX_PIN
+#else
+#define HIL_TX_PIN LINK_RX_PIN
+#endif
+
+void robot_start();     // main.cpp
+
+static uint8_t seq = 0;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void inject(const uint8_t * payload, uint8_t len)
+{
+    uint8_t frame[PROTO_MAX_FRAME];
+    size_t n = proto_encode(frame, seq++, payload, len);
+    uart_write_bytes(HIL_UART, frame, n);
+}
+
+static void inject_velocity(int16_t rate)
+{
+    uint8_t cmd[1 + 4] = {OP_VELOCITY};
+    proto_put_u16(proto_put_u16(&cmd[1], rate), rate);
+    inject(cmd, sizeof(cmd));
+}
+
+static void inject_stop()
+{
+    uint8_t cmd[1] = {OP_STOP};
+    inject(cmd, sizeof(cmd));
+}
+
+// wait_for spins until done() holds or timeout_us passes, returns the time
+// taken or UINT32_MAX on a timeout
+template <typename F>
+static uint32_t wait_for(uint32_t start, uint32_t timeout_us, F &&done)
+{
+    while (!done())
+    {
+        if (micros() - start > timeout_us)
+            return UINT32_MAX;
+        taskYIELD();
+    }
+    return micros() - start;
+}
+
+// report prints the percentiles of n samples in us, UINT32_MAX ones count
+// as lost
+static void report(const char * name, uint32_t * samples, uint16_t n)
+{
+    std::sort(samples, samples + n);
+    uint16_t lost = 0;
+    while (lost < n && samples[n - 1 - lost] == UINT32_MAX)
+        lost++;
+    uint16_t got = n - lost;
+
+    char msg[128];
+    if (!got)
+        snprintf(msg, sizeof(msg), "%s: all %u samples lost", name, n);
+    else
+        snprintf(msg, sizeof(msg), "%s: p50 %lu us, p90 %lu us, p99 %lu us, max %lu us (%u samples, %u lost)",
+                 name, (unsigned long)samples[got / 2], (unsigned long)samples[got * 9 / 10],
+                 (unsigned long)samples[got * 99 / 100], (unsigned long)samples[got - 1], got, lost);
+    TEST_MESSAGE(msg);
+}
+
+// frame in -> commanded rate, and frame in -> DIR line flipped on a
+// stopped wheel (the first ramp tick above STEPPER_MIN_RATE)
+static void test_command_latency()
+{
+    uint32_t samples[HIL_SAMPLES];
+    char msg[64];
+    snprintf(msg, sizeof(msg), "link at %lu baud, a 10 byte frame is %lu us on the wire",
+             (unsigned long)link_baud(), (unsigned long)(100000000ULL / link_baud()));
+    TEST_MESSAGE(msg);
+
+    for (uint16_t i = 0; i < HIL_SAMPLES; i++)
+    {
+        int16_t rate = i % 2 ? HIL_TEST_RATE : -HIL_TEST_RATE;
+        uint32_t start = micros();
+        inject_velocity(rate);
+        samples[i] = wait_for(start, 50000, [&] { return stepper_rate(0) == rate; });
+        delay(5);
+    }
+    report("frame -> rate", samples, HIL_SAMPLES);
+
+    uint16_t n = HIL_SAMPLES / 5;
+    for (uint16_t i = 0; i < n; i++)
+    {
+        inject_stop();
+        wait_for(micros(), 1000000, [] { return stepper_output_rate(0) == 0; });
+
+        // only a request against the direction still latched moves the line
+        uint8_t dir = gpio_fast_out(robot.motors[0].dir);
+        int16_t rate = dir == robot.motors[0].fwd_level ? -HIL_TEST_RATE : HIL_TEST_RATE;
+        uint32_t start = micros();
+        inject_velocity(rate);
+        samples[i] = wait_for(start, 200000, [&] { return gpio_fast_out(robot.motors[0].dir) != dir; });
+        delay(20);
+    }
+    inject_stop();
+    report("frame -> DIR", samples, n);
+}
+
+// sustained frames/s and commands/s the link takes without dropping any
+static void test_command_rate()
+{
+    uint8_t single[1] = {OP_HEARTBEAT};
+    uint8_t batch[PROTO_MAX_PAYLOAD];
+    memset(batch, OP_HEARTBEAT, sizeof(batch));
+
+    struct
+    {
+        const char * name;
+        const uint8_t * payload;
+        uint8_t len;
+    } runs[] = {
+        {"single command frames", single, sizeof(single)},
+        {"full frames", batch, sizeof(batch)},
+    };
+
+    for (auto &run : runs)
+    {
+        link_stats before = link_get_stats();
+        uint32_t sent = 0;
+        uint32_t start = micros();
+        while (micros() - start < HIL_WINDOW_MS * 1000)
+        {
+            inject(run.payload, run.len);
+            sent++;
+        }
+        wait_for(micros(), 200000, [&] { return link_get_stats().frames - before.frames >= sent; });
+        uint32_t elapsed = micros() - start;
+
+        link_stats after = link_get_stats();
+        uint32_t got = after.frames - before.frames;
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%s: %lu frames/s, %lu commands/s, %lu dropped, %lu overflows",
+                 run.name, (unsigned long)(got * 1000000ULL / elapsed),
+                 (unsigned long)(got * (uint64_t)run.len * 1000000ULL / elapsed),
+                 (unsigned long)(after.dropped - before.dropped),
+                 (unsigned long)(after.overflows - before.overflows));
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_EQUAL_UINT32(sent, got + (after.dropped - before.dropped));
+    }
+}
+
+// per channel update rate, echo -> published planner output, and the cost
+// of the echo capture ISR
+static void test_sensors()
+{
+    uint32_t updates[SENSOR_COUNT] = {};
+    uint32_t last_t[SENSOR_COUNT] = {};
+    uint32_t latency[HIL_SAMPLES];
+    uint16_t n = 0;
+    uint32_t version = 0;
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+        last_t[i] = ultrasonic_sample(i).t_us;
+    prof_totals isr_before = prof_get(PROF_ECHO_ISR);
+
+    uint32_t start = micros();
+    uint32_t beat_us = 0;
+    while (micros() - start < HIL_WINDOW_MS * 1000)
+    {
+        // keeps the link watchdog from stopping the robot meanwhile
+        if (micros() - beat_us > LINK_TIMEOUT_MS * 1000 / 4)
+        {
+            uint8_t beat[1] = {OP_HEARTBEAT};
+            inject(beat, sizeof(beat));
+            beat_us = micros();
+        }
+
+        sensor_frame frame;
+        if (sensor_state.version() == version || !sensor_state.try_read(frame))
+        {
+            delay(1);
+            continue;
+        }
+        version = sensor_state.version();
+
+        for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+        {
+            echo_sample s = ultrasonic_sample(i);
+            if (s.t_us == last_t[i])
+                continue;
+            last_t[i] = s.t_us;
+            updates[i]++;
+            // the falling echo edge is trigger time plus the pulse width,
+            // the sensor's own burst delay makes this an upper bound
+            if (s.status == ECHO_OK && n < HIL_SAMPLES)
+                latency[n++] = frame.t_us - (s.t_us + s.echo_us);
+        }
+    }
+    uint32_t elapsed = micros() - start;
+    prof_totals isr = prof_get(PROF_ECHO_ISR);
+
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+    {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "sensor %u: %lu.%lu updates/s", i,
+                 (unsigned long)(updates[i] * 1000000ULL / elapsed),
+                 (unsigned long)(updates[i] * 10000000ULL / elapsed % 10));
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_GREATER_THAN_UINT32(0, updates[i]);
+    }
+
+    uint32_t count = isr.count - isr_before.count;
+    uint64_t cycles = isr.cycles - isr_before.cycles;
+    uint32_t mhz = getCpuFrequencyMhz();
+    char msg[128];
+    snprintf(msg, sizeof(msg), "echo ISR: %lu calls, mean %lu cycles, max %lu cycles, %lu ppm of one core",
+             (unsigned long)count, (unsigned long)(count ? cycles / count : 0), (unsigned long)isr.max,
+             (unsigned long)(cycles * 1000000ULL / ((uint64_t)elapsed * mhz)));
+    TEST_MESSAGE(msg);
+
+    if (!n)
+        TEST_IGNORE_MESSAGE("no echoes came back, point the sonars at something for echo -> plan");
+    report("echo -> plan", latency, n);
+}
+
+// frame in -> trigger pulled. Off unless built with -DHIL_FIRE, the gun
+// really fires.
+static void test_fire_latency()
+{
+#ifndef HIL_FIRE
+    TEST_IGNORE_MESSAGE("build with -DHIL_FIRE to measure the trigger, the gun fires");
+#else
+    uint32_t samples[5];
+    for (uint16_t i = 0; i < 5; i++)
+    {
+        wait_for(micros(), 5000000, [] { return gun_get_state() == GUN_IDLE; });
+        uint8_t cmd[1 + 2] = {OP_FIRE, 1, GUN_TRACKING};
+        uint32_t start = micros();
+        inject(cmd, sizeof(cmd));
+        samples[i] = wait_for(start, 200000, [] { return gpio_fast_out(robot.gun) == LOW; });
+    }
+    report("frame -> trigger", samples, 5);
+#endif
+}
+
+void setup()
+{
+    // time for the serial monitor to attach
+    delay(2000);
+
+    uart_config_t cfg = {};
+    cfg.baud_rate = LINK_BAUD;
+    cfg.data_bits = UART_DATA_8_BITS;
+    cfg.parity = UART_PARITY_DISABLE;
+    cfg.stop_bits = UART_STOP_BITS_1;
+    cfg.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    cfg.source_clk = UART_SCLK_APB;
+    uart_driver_install(HIL_UART, 256, 2048, 0, NULL, 0);
+    uart_param_config(HIL_UART, &cfg);
+
+    robot_start();
+
+    // driving the link's own RX pad loops the frames back inside the chip,
+    // the pad has to keep its input enabled for that (as for the PUL pads)
+    uart_set_pin(HIL_UART, HIL_TX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    PIN_INPUT_ENABLE(GPIO_PIN_MUX_REG[LINK_RX_PIN]);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_command_latency);
+    RUN_TEST(test_command_rate);
+    RUN_TEST(test_sensors);
+    RUN_TEST(test_fire_latency);
+    UNITY_END();
+}
+
+void loop()
+{
+    vTaskDelete(NULL);
+}
@@ -1,3 +1,5 @@
+import math
+import time
 import cv2
 from Constants import Constants
 from FaceBuffer import FaceBuffer, RawFace, Face
@@ -32,9 +34,27 @@ def displayFrame(frame):
     cv2.imshow('Sentinel Dart X', frame)
     cv2.waitKey(1)
 
+def pixelAngle(offset):
+    """Degrees off the camera axis of a point offset pixels from center,
+    clockwise (to the right) positive."""
+    halfWidth = Constants.captureResolutionWidth / 2
+    halfFov = math.radians(Constants.cameraFovDeg / 2)
+    return math.degrees(math.atan(offset / halfWidth * math.tan(halfFov)))
+
+def pixelAngleRate(offset, velocity):
+    """Degrees/s the direction to a point offset pixels from center turns
+    at while it moves velocity pixels/s across the image."""
+    dt = 0.01
+    return (pixelAngle(offset + velocity * dt) - pixelAngle(offset)) / dt
+
 def loop(faceCascade, cap, fb, s, cs):
+    #id of the aiming rotation in flight, frames grabbed while it runs are
+    #smeared and the face positions in them are stale
+    aimSegment = None
+    aimTime = 0
     while True:
         ret, frame = cap.read()
+        frameTime = time.monotonic()
         
         if not ret:
             print("Failed to grab frame")
@@ -45,12 +65,15 @@ def loop(faceCascade, cap, fb, s, cs):
         faces = faceCascade.detectMultiScale(gray, scaleFactor=Constants.cascadeScaleFactor, minNeighbors=Constants.cascadeMinNeighbors)
         
         rawFaces = [RawFace(face[0], face[1], face[2], face[3]) for face in faces]
-        fb.processNewFrame(rawFaces)
+        fb.processNewFrame(rawFaces, frameTime)
         
         if debug():
             trackedFaces = fb.getFaces()
             drawTrackedFaces(trackedFaces, resizedFrame)
         
+        if deployed():
+            cs.poll()
+
         oldestFace = fb.getOldestTrackedFace()
         
         
@@ -62,29 +85,35 @@ def loop(faceCascade, cap, fb, s, cs):
             def pixelArea(face):
                 return face.w * face.h
 
+            # the firmware extrapolates the bearing between frames and
+            # steers onto it at its own rate
+            bearing = pixelAngle(deltaFromCenter(oldestFace))
+            bearingRate = pixelAngleRate(deltaFromCenter(oldestFace), oldestFace.velocityX())
 
             if abs(deltaFromCenter(oldestFace)) < Constants.maxXDistanceFromCenter:
                 if pixelArea(oldestFace) >= Constants.minimumPixelAreaFireRange:
                     if deployed():
-                        cs.fire()
+                        cs.track(bearing, bearingRate, fire=True)
                     if debug():
                         cv2.putText(resizedFrame, "FIRE", (0,80), cv2.FONT_HERSHEY_SIMPLEX, 3.0, (0, 0, 255), 2, cv2.LINE_AA)
                     if s != None:
                         s.play()
                 else:
                     if deployed():
-                        cs.move(forward=True)
+                        cs.track(bearing, bearingRate, Constants.driveSpeed)
                     if debug():
                         cv2.putText(resizedFrame, "FORWARD", (0,80), cv2.FONT_HERSHEY_SIMPLEX, 3.0, (0, 0, 255), 2, cv2.LINE_AA)
             else:
+                # one exact move onto the face instead of steering in, the
+                # next frame after it completes decides whether to fire
+                if deployed() and (aimSegment is None or cs.segments.get(aimSegment) is not None
+                                   or time.monotonic() - aimTime > Constants.aimTimeout):
+                    aimSegment = cs.rotateBy(pixelAngle(deltaFromCenter(oldestFace)))
+                    aimTime = time.monotonic()
                 if deltaFromCenter(oldestFace) < 0:
-                    if deployed():
-                        cs.rotate(clockwise=False)
                     if debug():
                         cv2.putText(resizedFrame, "ROTATE LEFT", (0,80), cv2.FONT_HERSHEY_SIMPLEX, 3.0, (0, 0, 255), 2, cv2.LINE_AA)
                 else:
-                    if deployed():
-                        cs.rotate(clockwise=True)
                     if debug():
                         cv2.putText(resizedFrame, "ROTATE RIGHT", (0,80), cv2.FONT_HERSHEY_SIMPLEX, 3.0, (0, 0, 255), 2, cv2.LINE_AA)
         else:
@@ -105,7 +134,10 @@ def main():
     if Constants.enableSound:
         s = Sound()
     if deployed():
-        cs = Commands(Constants.serialDevice)
+        if Constants.linkTransport == "udp":
+            cs = Commands(Constants.robotAddress, transport="udp")
+        else:
+            cs = Commands(Constants.serialDevice)
     else:
         cs = None
     if Constants.enableSound: 
@@ -0,0 +1,17 @@
+from setuptools import setup, Extension
+
+# The host side codec is compiled from the firmware's own protocol.h, so the
+# two ends of the link cannot disagree on the wire format.
+#   python3 setup.py build_ext --inplace
+codec = 'esp32_platformio_code/lib/sdx_protocol'
+
+setup(
+    name='sdx_protocol',
+    version='1.0',
+    description='Sentinel Dart X robot link codec',
+    ext_modules=[Extension('sdx_protocol',
+                           sources=[codec + '/python/sdx_protocol.cpp'],
+                           include_dirs=[codec + '/src'],
+                           extra_compile_args=['-std=c++17'],
+                           language='c++')],
+)
@@ -3,4 +3,7 @@
 
 source /home/user/venvs/deepface/bin/activate
 
+# the link codec is compiled from the firmware headers, rebuilt if they changed
+(cd /home/user/Code && python setup.py -q build_ext --inplace)
+
 python /home/user/Code/main.py